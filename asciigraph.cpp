@@ -6,344 +6,1179 @@
 
 #include "asciigraph.h"
 #include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
 #include <iostream>
+#include <exception>
+#include <cerrno>
+#include <climits>
+#include <limits>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "threadpool.h"
+
+// Graphs with more cells than this are rendered in parallel if possible
+#define PARALLEL_RENDER_MIN (1 << 20)
+
+// Floating point values this close above a multiple of a step (relative to
+// the step) are taken as that multiple, so that e.g. 0.3 is in the column
+// of 0.3 with xstep 0.1
+#define STEP_EPSILON 1e-9
 
 #define DEBUG if(debug)
 
-asciigraph::asciigraph(const std::vector<std::pair<int, int>> Fx,
-		       const int _xmin, const int _xmax, const int _xstep,
-		       const int _ymin, const int _ymax, const int _ystep,
-		       const bool _debug,               // = false
-		       const char _X_AXIS_CHAR,         // = ..._DEFAULT
-		       const char _Y_AXIS_CHAR,         // = ..._DEFAULT
-		       const char _GUIDELINE_CHAR,      // = ..._DEFAULT
-		       const char _POINT_CHAR,          // = ..._DEFAULT
-		       const int  _X_LABEL_DENSITY,     // = ..._DEFAULT
-		       const int  _GUIDELINE_DENSITY,   // = ..._DEFAULT
-		       const std::string _X_AXIS_LABEL, // = ..._DEFAULT
-		       const std::string _Y_AXIS_LABEL, // = ..._DEFAULT
-		       const int _WIDTH_PAD,            // = ..._DEFAULT
-		       const bool _BAR_ZERO_POINT       // = ..._DEFAULT
+/* Class graph_sink:
+   Where render() writes a graph, a buffer at a time.
+*/
+class graph_sink {
+public:
+  virtual ~graph_sink() {}
+  virtual void write(const char *p, const std::size_t n) = 0;
+  // Writes the buffers in order
+  virtual void write(const std::vector<std::string> &bufs){
+    for(auto it = bufs.begin(); it != bufs.end(); ++it){
+      write(it -> data(), it -> size());
+    }
+  }
+  virtual void flush() {}
+};
+
+// Writes to a stream
+class stream_sink : public graph_sink {
+public:
+  explicit stream_sink(std::ostream &_out) : out(_out) {}
+  void write(const char *p, const std::size_t n) override { out.write(p, n); }
+  void flush() override { out.flush(); }
+private:
+  std::ostream &out;
+};
+
+// Stores what fits in a buffer, counting all of it
+class buffer_sink : public graph_sink {
+public:
+  buffer_sink(char *_buf, const std::size_t _size)
+    : buf(_buf), size(_size), total(0) {}
+  void write(const char *p, const std::size_t n) override {
+    if(total < size) std::copy_n(p, std::min(n, size - total), buf + total);
+    total += n;
+  }
+  std::size_t count() const { return total; }
+private:
+  char *buf;
+  std::size_t size, total;
+};
+
+// Writes to a file descriptor, gathering several buffers per writev()
+class fd_sink : public graph_sink {
+public:
+  explicit fd_sink(const int _fd) : fd(_fd), ok(true) {}
+  void write(const char *p, const std::size_t n) override {
+    struct iovec iov = {const_cast<char *>(p), n};
+    writev_all(&iov, 1);
+  }
+  void write(const std::vector<std::string> &bufs) override {
+    std::vector<struct iovec> iov;
+    iov.reserve(bufs.size());
+    for(auto it = bufs.begin(); it != bufs.end(); ++it){
+      if(it -> empty()) continue;
+      iov.push_back({const_cast<char *>(it -> data()), it -> size()});
+    }
+    for(std::size_t i = 0; i < iov.size(); i += IOV_MAX){
+      writev_all(iov.data() + i, std::min<std::size_t>(IOV_MAX, iov.size() - i));
+    }
+  }
+  bool written() const { return ok; }
+private:
+  // Writes all of iov, resuming after partial writes
+  void writev_all(struct iovec *iov, int cnt){
+    while(ok && cnt > 0){
+      ssize_t n = writev(fd, iov, cnt);
+      if(n < 0){
+	if(errno != EINTR) ok = false;
+	continue;
+      }
+      for(; cnt > 0 && (std::size_t)n >= iov -> iov_len; ++iov, --cnt){
+	n -= iov -> iov_len;
+      }
+      if(cnt > 0){
+	iov -> iov_base = static_cast<char *>(iov -> iov_base) + n;
+	iov -> iov_len -= n;
+      }
+    }
+  }
+  int fd;
+  bool ok;
+};
+/* steps_from():
+   The number of whole steps of the given size from origin to v (at least
+   origin), i.e. the column holding v when columns start at origin. */
+template <typename Value>
+static long long steps_from(const Value origin, const Value v,
+			    const Value step){
+  if constexpr (std::is_integral<Value>::value){
+    // (Found exactly, for limits and steps spanning more than 64 bits;
+    //  spans of more than LLONG_MAX steps are rejected by layout())
+    const __int128 steps = ((__int128)v - origin)/step;
+    return (steps > LLONG_MAX)  ?  LLONG_MAX : (long long)steps;
+  }
+  else return (long long)std::floor((v - origin)/step + STEP_EPSILON);
+}
+
+// Formats v as a label into buf, returning its length
+template <typename Value>
+static int format_value(char *buf, const std::size_t size, const Value v){
+  if constexpr (std::is_integral<Value>::value){
+    return std::snprintf(buf, size, "%lld", (long long)v);
+  }
+  else return std::snprintf(buf, size, "%g", (double)v);
+}
+
+template <typename Value, graph_kind Kind>
+basic_asciigraph<Value, Kind>::basic_asciigraph(const std::vector<point> &Fx,
+		       const Value _xmin, const Value _xmax, const Value _xstep,
+		       const Value _ymin, const Value _ymax, const Value _ystep,
+		       const bool _debug,                // = false
+		       const char _X_AXIS_CHAR,          // = ..._DEFAULT
+		       const char _Y_AXIS_CHAR,          // = ..._DEFAULT
+		       const char _GUIDELINE_CHAR,       // = ..._DEFAULT
+		       const char _POINT_CHAR,           // = ..._DEFAULT
+		       const int  _X_LABEL_DENSITY,      // = ..._DEFAULT
+		       const int  _GUIDELINE_DENSITY,    // = ..._DEFAULT
+		       const std::string &_X_AXIS_LABEL, // = ..._DEFAULT
+		       const std::string &_Y_AXIS_LABEL, // = ..._DEFAULT
+		       const int _WIDTH_PAD,             // = ..._DEFAULT
+		       const bool _BAR_ZERO_POINT,       // = ..._DEFAULT
+		       const bool _ELIDE_GAPS,           // = ..._DEFAULT
+		       const char _GAP_CHAR,             // = ..._DEFAULT
+		       const bool _BRAILLE               // = ..._DEFAULT
+		       )
+  : legend(nullptr), stats(nullptr), parallel(true), counting(false){
+  reset(_xmin, _xmax, _xstep, _ymin, _ymax, _ystep, _debug,
+	_X_AXIS_CHAR, _Y_AXIS_CHAR, _GUIDELINE_CHAR, _POINT_CHAR,
+	_X_LABEL_DENSITY, _GUIDELINE_DENSITY, _X_AXIS_LABEL, _Y_AXIS_LABEL,
+	_WIDTH_PAD, _BAR_ZERO_POINT, _ELIDE_GAPS, _GAP_CHAR, _BRAILLE);
+  setPoints(Fx.data(), Fx.size());
+}
+
+template <typename Value, graph_kind Kind>
+basic_asciigraph<Value, Kind>::basic_asciigraph(std::vector<point> &&Fx,
+		       const Value _xmin, const Value _xmax, const Value _xstep,
+		       const Value _ymin, const Value _ymax, const Value _ystep,
+		       const bool _debug,                // = false
+		       const char _X_AXIS_CHAR,          // = ..._DEFAULT
+		       const char _Y_AXIS_CHAR,          // = ..._DEFAULT
+		       const char _GUIDELINE_CHAR,       // = ..._DEFAULT
+		       const char _POINT_CHAR,           // = ..._DEFAULT
+		       const int  _X_LABEL_DENSITY,      // = ..._DEFAULT
+		       const int  _GUIDELINE_DENSITY,    // = ..._DEFAULT
+		       const std::string &_X_AXIS_LABEL, // = ..._DEFAULT
+		       const std::string &_Y_AXIS_LABEL, // = ..._DEFAULT
+		       const int _WIDTH_PAD,             // = ..._DEFAULT
+		       const bool _BAR_ZERO_POINT,       // = ..._DEFAULT
+		       const bool _ELIDE_GAPS,           // = ..._DEFAULT
+		       const char _GAP_CHAR,             // = ..._DEFAULT
+		       const bool _BRAILLE               // = ..._DEFAULT
 		       )
-  : ymin(_ymin), ymax(_ymax), ystep(_ystep),
-    xmin(_xmin), xmax(_xmax), xstep(_xstep),
-    debug(_debug),
-    X_AXIS_CHAR       (_X_AXIS_CHAR),
-    Y_AXIS_CHAR       (_Y_AXIS_CHAR),
-    GUIDELINE_CHAR    (_GUIDELINE_CHAR),
-    POINT_CHAR        (_POINT_CHAR), 
-    X_LABEL_DENSITY   (_X_LABEL_DENSITY),
-    GUIDELINE_DENSITY (_GUIDELINE_DENSITY),
-    X_AXIS_LABEL      (_X_AXIS_LABEL),
-    Y_AXIS_LABEL      (_Y_AXIS_LABEL),
-    WIDTH_PAD         (_WIDTH_PAD),
-    BAR_ZERO_POINT    (_BAR_ZERO_POINT){
-  /* Error checking */
-  if(ymin >= ymax || ystep < 1 ||
-     xmin >= xmax || xstep < 1){
+  : legend(nullptr), stats(nullptr), parallel(true), counting(false){
+  reset(_xmin, _xmax, _xstep, _ymin, _ymax, _ystep, _debug,
+	_X_AXIS_CHAR, _Y_AXIS_CHAR, _GUIDELINE_CHAR, _POINT_CHAR,
+	_X_LABEL_DENSITY, _GUIDELINE_DENSITY, _X_AXIS_LABEL, _Y_AXIS_LABEL,
+	_WIDTH_PAD, _BAR_ZERO_POINT, _ELIDE_GAPS, _GAP_CHAR, _BRAILLE);
+  setPoints(std::move(Fx));
+}
+
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::reset(
+		       const Value _xmin, const Value _xmax, const Value _xstep,
+		       const Value _ymin, const Value _ymax, const Value _ystep){
+  /* Error checking (written to also reject NaNs) */
+  if(!(_ymin < _ymax) || !(_ystep > 0) ||
+     !(_xmin < _xmax) || !(_xstep > 0)){
     throw std::logic_error("Limits or steps illogical");
   }
-    
+  ymin = _ymin;  ymax = _ymax;  ystep = _ystep;
+  xmin = _xmin;  xmax = _xmax;  xstep = _xstep;
+  clear();
+}
+
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::reset(
+		       const Value _xmin, const Value _xmax, const Value _xstep,
+		       const Value _ymin, const Value _ymax, const Value _ystep,
+		       const bool _debug,
+		       const char _X_AXIS_CHAR, const char _Y_AXIS_CHAR,
+		       const char _GUIDELINE_CHAR, const char _POINT_CHAR,
+		       const int _X_LABEL_DENSITY, const int _GUIDELINE_DENSITY,
+		       const std::string &_X_AXIS_LABEL,
+		       const std::string &_Y_AXIS_LABEL,
+		       const int _WIDTH_PAD, const bool _BAR_ZERO_POINT,
+		       const bool _ELIDE_GAPS, const char _GAP_CHAR,
+		       const bool _BRAILLE){
+  reset(_xmin, _xmax, _xstep, _ymin, _ymax, _ystep);
+  debug = _debug;
+  X_AXIS_CHAR       = _X_AXIS_CHAR;
+  Y_AXIS_CHAR       = _Y_AXIS_CHAR;
+  GUIDELINE_CHAR    = _GUIDELINE_CHAR;
+  POINT_CHAR        = _POINT_CHAR;
+  X_LABEL_DENSITY   = _X_LABEL_DENSITY;
+  GUIDELINE_DENSITY = _GUIDELINE_DENSITY;
+  X_AXIS_LABEL      = _X_AXIS_LABEL; // Assigned to keep their memory
+  Y_AXIS_LABEL      = _Y_AXIS_LABEL;
+  WIDTH_PAD         = _WIDTH_PAD;
+  BAR_ZERO_POINT    = _BAR_ZERO_POINT;
+  ELIDE_GAPS        = _ELIDE_GAPS;
+  GAP_CHAR          = _GAP_CHAR;
+  BRAILLE           = _BRAILLE;
+  marks.clear();
+  MARK_CHAR         = MARK_CHAR_DEFAULT;
+  legend            = nullptr;
+  series_chars.clear();
+  counting          = false;
+}
+
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::setPoints(std::vector<point> &&Fx){
+  clear();
+  points.swap(Fx);
+  // Points given as (x, y) - transpose into (y , x) in place
+  for(auto it = points.begin(); it != points.end(); ++it){
+    std::swap(it -> first, it -> second);
+  }
+}
+
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::setPoints(std::vector<point> &&Fx,
+					      std::vector<uint8_t> &&S){
+  if(S.size() != Fx.size()){
+    throw std::logic_error("Series and points do not match");
+  }
+  setPoints(std::move(Fx));
+  series.swap(S);
+  S.clear();
+}
+
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::setPoints(const point *Fx,
+					      const std::size_t n){
+  clear();
+  points.reserve(n);
   // Points given as (x, y) - transpose into (y , x)
-  for(auto it = Fx.begin(); it != Fx.end(); ++it){
-    points.push_back(std::pair<int, int>(it -> second, it -> first));
+  for(std::size_t i = 0; i < n; ++i){
+    points.push_back(point(Fx[i].second, Fx[i].first));
   }
 }
 
 
-void asciigraph::operator()(std::ostream &out,
-			    const bool bar_graph /* = false */){
-  int y, ymin_rnd;
-  auto graphpoints = prepare_data(points, &y, &ymin_rnd);
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::operator()(std::ostream &out){
+  stream_sink sink(out);
+  draw(sink);
+}
 
-  int marked_last_row = 0;
+template <typename Value, graph_kind Kind>
+std::size_t basic_asciigraph<Value, Kind>::operator()(char *buf,
+						      const std::size_t size){
+  buffer_sink sink(buf, size);
+  draw(sink);
+  return sink.count();
+}
 
-  /*******************************/
-  /***** Set up bar tracking *****/
-  /*******************************/
-  /* print_bar contains values indicating if a bar should be printed
-     for each x-value at the current y-value. It is updated with the handling
-     of each y value.
-     0 = don't print a bar for this x-value on this y-value's row
-     1 = print a bar for this x-value on this row above the x-axis
-     2 = print a bar for this x-value on this row below the x-axis
+template <typename Value, graph_kind Kind>
+bool basic_asciigraph<Value, Kind>::operator()(const int fd){
+  fd_sink sink(fd);
+  draw(sink);
+  return sink.written();
+}
 
-     Since graphs are printed by starting at ymax and working down to ymin
-     this system works well for positive y-values. print_bar begins with
-     all 0s and when a point is printed, its corresponding print_bar
-     value is set to 1: then every pass/row after that will print a bar
-     underneath that point.
-     For negative values, however, it must work in the opposite manner.
-     The default must be to print the bar, until the point is reached, at which
-     point the bar must stop.
-  */
-  std::vector< int > print_bar(xmax + 1, 0); // fill print_bar with 0s
-  // Initialize any negative values print_bar values
-  /* Iterate backwards (since graphpoints in descending order) to set all
-     negative points in print_bar */
-  for (auto it2 = graphpoints.rbegin();
-       it2 != graphpoints.rend()   &&   it2 -> first < 0;
-       ++it2){
-    print_bar[it2 -> second] = 2;
+// Prepares and draws the graph to out
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::draw(graph_sink &out){
+  if(stats == nullptr){
+    prepare_data();
+    render(out);
+    return;
   }
+  double start = stats_clock();
+  prepare_data();
+  stats -> prepare_s += stats_clock() - start;
+  const double output_s = stats -> output_s;
+  start = stats_clock();
+  render(out);
+  // Writing is timed on its own by write_out()
+  stats -> render_s += stats_clock() - start - (stats -> output_s - output_s);
+}
 
+// Draws the prepared graph
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::render(std::ostream &out){
+  stream_sink sink(out);
+  render(sink);
+}
+
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::render(graph_sink &out){
   /*********************************/
   /***** Prepare to draw graph *****/
   /*********************************/
+  build_row_templates();
   // Print y-axis label
-  out << Y_AXIS_LABEL << std::endl;
-  
-  std::vector<std::pair<int, int>> used; // Keep track of points plotted
-
-  auto it = graphpoints.begin();
-  // Deal with any points above ymax (only occurs if user sets ymax)
-  while(it -> first > y){ // For all points above graph
-    if(bar_graph){
-      // Set print_bar for this x value
-      print_bar[it -> second] = (y > 0  ?  1 : 0);
-    }
-    // else: just skip the point
-    it++;
-  }
+  row = Y_AXIS_LABEL;
+  row += '\n';
+  const int rows = grid.braille  ?  (grid.nrows + 3)/4 : grid.nrows;
+  const std::size_t words = render_words();
 
   /**********************/
   /***** Draw graph *****/
   /**********************/
   
-  /* Plot points */
-  // For each y-value from ymax_rnd to ymin_rnd
-  // so long as there are points left to plot
-  for(; y >= ymin_rnd && it != graphpoints.end(); y -= ystep){
-
-    /* y-axis labelling */
-    DEBUG std::cerr << "labelling ";
-    // Label padding
-    if(y >= 0)
-      for(int i = ((y == 0) ? 1 : y)  ; i < 10000000  ; i *= 10) out << " ";
-    else
-      for(int i = -y; i < 1000000; i *= 10) out << " ";
-    out << y << " "; // y-axis label
-    out << Y_AXIS_CHAR; // Y-axis line
+  /* Rows depend only on the raster, so large graphs are rendered a few
+     bands of rows per thread, each into its own buffer */
+  const std::size_t cells = (std::size_t)grid.nrows*grid.ncols;
+  // (The pool is only started for graphs which may use it)
+  thread_pool *pool = (parallel && !debug && cells >= PARALLEL_RENDER_MIN)  ?
+                      &shared_pool() : nullptr;
+  if(pool && pool -> size() >= 2){
+    const std::size_t nparts = std::min<std::size_t>(4*pool -> size(), rows);
+    std::vector<std::string> parts(nparts);
+    std::vector<std::exception_ptr> errors(nparts);
+    pool -> run(nparts, [&](std::size_t k){
+	try{
+	  std::vector<uint64_t> bits(words, 0);
+	  render_rows(rows*k/nparts, rows*(k + 1)/nparts, parts[k], bits);
+	}catch(...){
+	  errors[k] = std::current_exception();
+	}
+      });
+    for(std::size_t k = 0; k < nparts; ++k){
+      if(errors[k]) std::rethrow_exception(errors[k]);
+    }
+    write_out(out, row);
+    const double start = stats  ?  stats_clock() : 0;
+    out.write(parts);
+    if(stats) stats -> output_s += stats_clock() - start;
+  }
+  else{
+    // Rows are written out a batch at a time
+    row_bits.assign(words, 0);
+    for(int r = 0; r < rows; ++r){
+      render_rows(r, r + 1, row, row_bits);
+      if(row.size() >= RENDER_BATCH_SIZE){
+	write_out(out, row);
+	row.clear();
+      }
+    }
+    write_out(out, row);
+  }
+  /* Done plotting points */
+  
+  label_x_axis(out);
+  write_legend(out);
+  row = "\n\n";
+  write_out(out, row);
+  const double start = stats  ?  stats_clock() : 0;
+  out.flush();
+  if(stats) stats -> output_s += stats_clock() - start;
+}
 
+// The words of the bitmap of a row rendered: braille rows gather the dots
+// of their four rows, a bitmap of columns each
+template <typename Value, graph_kind Kind>
+std::size_t basic_asciigraph<Value, Kind>::render_words() const {
+  return grid.braille  ?  4*(((std::size_t)grid.ncols + 63) >> 6) :
+                          ((std::size_t)grid.ncols*grid.nseries + 63) >> 6;
+}
+
+template <typename Value, graph_kind Kind>
+int basic_asciigraph<Value, Kind>::unplot(const Value x, const Value y,
+					  const unsigned s){
+  if(!grid.dense || !counting) return -1;
+  const int c = column(x);
+  const Value pt_y = round_y(y);
+  if(c < 0 || s >= (unsigned)grid.nseries ||
+     !(pt_y <= grid.ytop && pt_y >= grid.ybottom)){
+    return -1;
+  }
+  const std::size_t r = row_of(pt_y);
+  const std::size_t i = (std::size_t)c*grid.nseries + s;
+  auto it = cell_counts.find(r*(grid.row_words << 6) + i);
+  if(it == cell_counts.end()) return -1;
+  if(--it -> second == 0){
+    cell_counts.erase(it);
+    grid.cells[r*grid.row_words + (i >> 6)] &= ~((uint64_t)1 << (i & 63));
+  }
+  return grid.braille  ?  (int)r/4 : (int)r;
+}
+
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::drawRows(const int first, const int last,
+					     std::string &buf){
+  if(!grid.dense || !points.empty() ||
+     grid.row_start.size() != (std::size_t)grid.nrows + 1){
+    throw std::logic_error("Graph not drawn from plotted points");
+  }
+  const int rows = grid.braille  ?  (grid.nrows + 3)/4 : grid.nrows;
+  row_bits.assign(render_words(), 0);
+  render_rows(std::max(first, 0), std::min(last, rows), buf, row_bits);
+}
+
+// Writes buf to out, timing it if collecting stats
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::write_out(graph_sink &out,
+					      const std::string &buf){
+  if(stats == nullptr){
+    out.write(buf.data(), buf.size());
+    return;
+  }
+  const double start = stats_clock();
+  out.write(buf.data(), buf.size());
+  stats -> output_s += stats_clock() - start;
+}
+
+/* Turns the prepared points drawn back into (y, x) points, the y-value
+   rounded and the x-value the first of its column, so that they can be
+   prepared again (e.g. once more points have been added) */
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::restore_points(){
+  const std::size_t drawn = grid.row_start[grid.nrows];
+  const int ns = grid.nseries;
+  for(std::size_t i = 0; i < drawn; ++i){
+    point &pt = points[i];
+    const int code = (int)pt.second;
+    if(!series.empty()) series[i] = code%ns;
+    pt = point(row_y((int)pt.first), (Value)column_x(code/ns));
+  }
+  grid.prepared = false;
+}
+
+// Appends rows [first, last) of the graph to buf (each from the template of
+// its kind of row); bits must be all 0
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::render_rows(const int first,
+						const int last,
+						std::string &buf,
+						std::vector<uint64_t> &bits) const {
+  if(grid.braille){
+    render_braille_rows(first, last, buf, bits);
+    return;
+  }
+  for(int r = first; r < last; ++r){
+    const Value y = row_y(r);
+    // Guidelines are drawn on every GUIDELINE_DENSITY'th row from the top
+    const bool guides = r%GUIDELINE_DENSITY == 0;
+    const std::string &tmpl = (r == grid.axis)  ?  axis_row :
+                              marked(r, r + 1)  ?  mark_row :
+                              (guides  ?  guide_row : blank_row);
+    begin_row(buf, y);
     DEBUG std::cerr << "y = " << y << std::endl;
-    /* Done labelling */
+
+    /* Mark the cells of the points in this row (duplicates collapse) */
+    if(grid.dense){
+      std::copy_n(grid.cells.begin() + r*grid.row_words, grid.row_words,
+		  bits.begin());
+    }
+    for(std::size_t i = grid.row_start[r]; i < grid.row_start[r + 1]; ++i){
+      const int code = (int)points[i].second;
+      bits[code >> 6] |= (uint64_t)1 << (code & 63);
+    }
     
     /* Plot points for this y value / row */
-    int xpos = xmin;
-    for(; it -> first == y && it != graphpoints.end(); ++it){
-      DEBUG std::cerr << "Handling pt: (" << it -> first << ", "
-		      << it -> second << ")\n";
-      // Print filler
-      while(xpos < it -> second){
-	if(y == 0){
-	  // if at y = 0, draw x-axis
-	  out << X_AXIS_CHAR << make_str(" ", WIDTH_PAD);
-	}
-	else{
-	  if(bar_graph  &&  print_bar[xpos] != 0){ // this xpos has bar ON
-	    if( (y >= 0 && print_bar[xpos] == 1) ||
-	        (y <  0 && print_bar[xpos] == 2)   ){
-	      out << POINT_CHAR << make_str(" ", WIDTH_PAD); // print bar
-	    }
-	    else out << make_str(" ", 1 + WIDTH_PAD);
-	  }
-	  else if(xpos%X_LABEL_DENSITY == 0 && !marked_last_row){
-	    out << GUIDELINE_CHAR << make_str(" ", WIDTH_PAD); // x guideline
-	  }
-	  else out << make_str(" ", 1 + WIDTH_PAD);
-	}
-	++xpos;
-      }// end while
-
-      // Don't plot same point twice...
-      if(std::find(used.begin(), used.end(), *it) == used.end()){
+    const int ns = grid.nseries;
+    int col = 0;
+    for(std::size_t w = 0; w < bits.size(); ++w){
+      for(uint64_t set = bits[w]; set != 0; set &= set - 1){
+	const int code = (int)(w << 6) + __builtin_ctzll(set);
+	const int c = (ns == 1)  ?  code : code/ns;
+	if(c < col) continue; // An earlier series is drawn in this cell
 	DEBUG std::cerr << "Printing point: (" << y << ", "
-			<< xpos << ")\n";
-	
-	if(!BAR_ZERO_POINT  &&  (bar_graph && y == 0)){
+			<< column_x(c) << ")\n";
+	// Print filler
+	fill_cells(buf, col, c, r, tmpl);
+
+	if(!BAR_ZERO_POINT  &&  (bar_graph && r == grid.axis)){
 	  // don't print point on axis for bar graphs
-	  out << X_AXIS_CHAR << make_str(" ", WIDTH_PAD);
+	  put_cell(buf, X_AXIS_CHAR);
 	}
 	else{
-	  out << POINT_CHAR << make_str(" ", WIDTH_PAD); // print point
-	}
-	if(bar_graph){
-	  print_bar[xpos] = (y >= 0  ?  1 : 0); // set bar for this xpos
+	  // print point, in the char of its series
+	  put_cell(buf, grid.point_chars[code - c*ns]);
 	}
-	++xpos;
-	used.push_back(*it);
+	col = c + 1;
       }
-    }// end for
+      bits[w] = 0;
+    }
     DEBUG std::cerr << "finished line " << y << std::endl;
 
     /* Fill remainder of row */
-    for(; xpos <= xmax; ++xpos){
-      if(y == 0){
-	// if at y = 0, draw x-axis
-	out << X_AXIS_CHAR << make_str(" ", WIDTH_PAD);
-      }
-      else{
-	if(bar_graph  &&  print_bar[xpos] != 0){ // if this xpos has bar ON
-	  if( (y >= 0 && print_bar[xpos] == 1) ||
-	      (y <  0 && print_bar[xpos] == 2)   ){
-	    out << POINT_CHAR << make_str(" ", WIDTH_PAD); // bar
-	  }
-	  else out << make_str(" ", 1 + WIDTH_PAD);
-	}
-	else if(xpos%X_LABEL_DENSITY == 0 && !marked_last_row){
-	  out << GUIDELINE_CHAR << make_str(" ", WIDTH_PAD); // x guideline
-	}
-	else out << make_str(" ", 1 + WIDTH_PAD);
-      }// end else
-    }// end for
-    marked_last_row = (marked_last_row + 1)%GUIDELINE_DENSITY;
-    out << std::endl;
-  }// end for
-  /* Done plotting points */
+    fill_cells(buf, col, grid.ncols, r, tmpl);
+    end_row(buf, r, r + 1);
+  }
+}
 
-  
-  /* Fill out any remaining rows of graph */
-  for(; y >= ymin_rnd; y -= ystep){
-    /* y-axis labelling */
-    DEBUG std::cerr << "labelling ";
-    // Label padding
-    if(y >= 0){
-      for(int i = ((y == 0) ? 1 : y)  ; i < 10000000  ; i *= 10){
-	out << " ";
-      }
+
+// rounds and buckets data for graphing
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::prepare_data(){
+  if(grid.prepared) restore_points();
+  if(grid.dense){
+    if constexpr (bar_graph){
+      throw std::logic_error("Plotted points cannot be drawn as bars");
     }
-    else{
-      for(int i = -y; i < 1000000; i *= 10){
-	out << " ";
-      }
+    // Any stored points join the plotted ones
+    for(std::size_t i = 0; i < points.size(); ++i){
+      plot(points[i].second, points[i].first,
+	   series.empty()  ?  0 : series[i]);
     }
-    out << y << " "; // y-axis label
-    out << Y_AXIS_CHAR; // Y-axis line
+    points.clear();
+    series.clear();
+    grid.row_start.assign(grid.nrows + 1, 0);
+    return;
+  }
+  layout();
+  if(grid.elided){
+    elide_gaps();
+  }
+  const Value y = grid.ytop, ymin_rnd = grid.ybottom;
 
-    DEBUG std::cerr << "y = " << y << std::endl;
-    /* Done labelling */
+  /*******************************/
+  /***** Set up bar tracking *****/
+  /*******************************/
+  /* bar_up and bar_down hold bits indicating if a bar should be printed
+     for each column above the first point in the column (see plan_bars()
+     for the rows below it).
+     neither  = don't print a bar for this column
+     bar_up   = print a bar for this column above the x-axis
+     bar_down = print a bar for this column below the x-axis
 
-    
-    for(int xpos = xmin; xpos <= xmax; ++xpos){
-      if(y == 0){
-	out << X_AXIS_CHAR << make_str(" ", WIDTH_PAD);
+     Since graphs are printed by starting at ymax and working down to ymin
+     bars of positive y-values start at their point and run down to the
+     x-axis, so columns begin without a bar.
+     For negative values, however, it must work in the opposite manner.
+     The default must be to print the bar, until the point is reached, at which
+     point the bar must stop.
+     Points above ymax (only occurs if user sets ymax) start their bar at the
+     top of the graph, taking precedence over negative points.
+  */
+  const std::size_t words = bar_graph  ?  ((std::size_t)grid.ncols + 63) >> 6 : 0;
+  grid.bar_up.assign(words, 0);
+  grid.bar_down.assign(words, 0);
+  // Columns with points above the graph, which negative points can't turn on
+  row_bits.assign(words, 0);
+
+  /* Bucket the points by row with a counting sort over [ymin_rnd, ymax_rnd],
+     in place:
+     - each point drawn is rewritten as (row, column) and kept at the front;
+       the rest (outside of the rows or columns) are not drawn and are moved
+       behind them as they are
+     - the front is then permuted so that rows hold the columns of their
+       points in points[row_start[r]]..points[row_start[r+1] - 1] */
+  const std::size_t rows = grid.nrows;
+  std::vector<std::size_t> &row_start = grid.row_start;
+  row_start.assign(rows + 1, 0);
+  if(ystep > 1){
+    DEBUG std::cerr << "ystep > 1 - performing rounding...\n";
+  }
+  const bool tagged = !series.empty();
+  const int ns = grid.nseries;
+  std::size_t drawn = 0, kept = points.size();
+  while(drawn < kept){
+    point &pt = points[drawn];
+    const int c = column(pt.second);
+    const int s = tagged  ?  series[drawn] : 0;
+    const Value pt_y = round_y(pt.first);
+    if(stats && pt_y != pt.first) ++stats -> rounded;
+    if constexpr (bar_graph){
+      if(c >= 0){
+	if(pt_y > y) set_bit(y > 0  ?  grid.bar_up : row_bits, c, true);
+	else if(pt_y < 0) set_bit(grid.bar_down, c, true);
       }
-      else if(bar_graph  &&  print_bar[xpos] != 0){ // if this xpos has bar ON
-	if( (y >= 0 && print_bar[xpos] == 1) ||
-	    (y <  0 && print_bar[xpos] == 2)   ){
-	  out << POINT_CHAR << make_str(" ", WIDTH_PAD); // bar
-	}
-	else out << make_str(" ", 1 + WIDTH_PAD);
+    }
+    if(c < 0 || s >= ns || !(pt_y <= y && pt_y >= ymin_rnd)){
+      if(stats) ++stats -> outside;
+      std::swap(pt, points[--kept]); // Look at the point swapped in next
+      if(tagged) std::swap(series[drawn], series[kept]);
+      continue;
+    }
+    const int r = row_of(pt_y);
+    pt = point(r, c*ns + s);
+    ++row_start[r + 1];
+    ++drawn;
+  }
+  for(std::size_t w = 0; w < words; ++w){
+    grid.bar_down[w] &= ~(grid.bar_up[w] | row_bits[w]);
+  }
+  for(std::size_t r = 1; r <= rows; ++r){
+    row_start[r] += row_start[r - 1];
+  }
+  // Cycle each point into the next free place of its row
+  std::vector<std::size_t> &next = grid.row_next;
+  next.assign(row_start.begin(), row_start.end() - 1);
+  for(std::size_t r = 0; r < rows; ++r){
+    for(std::size_t &i = next[r]; i < row_start[r + 1]; ++i){
+      point pt = points[i];
+      while((std::size_t)pt.first != r){
+	std::swap(pt, points[next[(std::size_t)pt.first]++]);
       }
-      else if(xpos%X_LABEL_DENSITY == 0 && !marked_last_row){
-	out << GUIDELINE_CHAR << make_str(" ", WIDTH_PAD); // x guideline
+      points[i] = pt;
+    }
+  }
+  grid.prepared = true;
+
+  if(stats){
+    // Points sharing a cell are drawn once
+    row_bits.assign(((std::size_t)grid.ncols + 63) >> 6, 0);
+    for(std::size_t r = 0; r < rows; ++r){
+      for(std::size_t i = row_start[r]; i < row_start[r + 1]; ++i){
+	const int c = (int)points[i].second/ns;
+	if(get_bit(row_bits, c)) ++stats -> duplicates;
+	else set_bit(row_bits, c, true);
+      }
+      for(std::size_t i = row_start[r]; i < row_start[r + 1]; ++i){
+	set_bit(row_bits, (int)points[i].second/ns, false);
       }
-      else out << make_str(" ", 1 + WIDTH_PAD);
     }
-    marked_last_row = (marked_last_row + 1)%GUIDELINE_DENSITY;
-    out << std::endl;
-    DEBUG std::cerr << "y = " << y << std::endl;
   }
-  /* Done filling in graph */
-  
-  label_x_axis(out);
-  out << "\n" << std::endl;
+
+  if constexpr (bar_graph) plan_bars();
 }
 
+/* Finds the rows in which each column shows its bar, so that any row can
+   be drawn on its own. Going down the graph, a column's bar state changes
+   only at its points: a point at y >= 0 starts a bar down to the x-axis,
+   and a point at y < 0 ends any bar. So for row r of column c,
+   above the x-axis (r < axis):
+     bar   if r >= bar_from[c]
+     blank if r <  bar_to[c]      (bar_down before the first point)
+   below the x-axis (r > axis):
+     bar   if r <  bar_to[c]
+     blank if r <  blank_to[c]    (bar_up until the first negative point)
+   where blank cells hide the guidelines the bars would otherwise show. */
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::plan_bars(){
+  const int rows = grid.nrows;
+  const int axis = grid.axis;
+  std::vector<int> &first = grid.bar_from, &first_neg = grid.blank_to;
+  first.assign(grid.ncols, rows);
+  first_neg.assign(grid.ncols, rows);
+  for(int r = rows - 1; r >= 0; --r){
+    for(std::size_t i = grid.row_start[r]; i < grid.row_start[r + 1]; ++i){
+      const int c = (int)points[i].second/grid.nseries;
+      first[c] = r;
+      if(r > axis) first_neg[c] = r;
+    }
+  }
+  grid.bar_to.resize(grid.ncols);
+  for(int c = 0; c < grid.ncols; ++c){
+    const bool up = get_bit(grid.bar_up, c), down = get_bit(grid.bar_down, c);
+    const int first_pt = first[c];
+    grid.bar_to[c] = down  ?  first_pt : 0;
+    grid.bar_from[c] = up  ?  0 : (first_pt < rows  ?  first_pt + 1 : rows);
+    if(!up && first_pt > axis) first_neg[c] = 0;
+  }
+}
 
-// rounds and sorts data for graphing
-std::vector< std::pair<int, int> >
-asciigraph::prepare_data(const std::vector< std::pair<int, int> > &pts,
-			 int *_y, int *_ymin_rnd){
-  /* If ystep > 1, round points to fit into multiple of ystep */
-  auto graphpoints = points; // Make copy to be manipulated for rounding
-  if(ystep > 1){
-    DEBUG std::cerr << "ystep > 1 - performing rounding...\n";
-    for(auto it = graphpoints.begin(); it != graphpoints.end(); ++it){
-      int pt_off_by = (it -> first)%ystep;
-      if(pt_off_by != 0){
-	DEBUG std::cerr << "Rounded (" << it -> first << ", "
-			 << it -> second << ") to ";
-	// Round the y-value to nearest multiple of ystep
-	if(it -> first > 0){
-	  it -> first +=
-	    (pt_off_by < ystep/2)  ?  -pt_off_by  :  ystep - pt_off_by;
-	}
-	else{
-	  DEBUG std::cerr << pt_off_by << " >= " << -ystep/2 << std::endl;
-	  it -> first +=
-	    (pt_off_by >= -ystep/2)  ?  -pt_off_by  :  -(ystep + pt_off_by);
-	}
-	DEBUG std::cerr << "(" << it -> first << ", " << it -> second << ")\n";
-      }
+// Rounds the limits and lays out the rows and columns of the graph
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::layout(){
+  /* Round graph limits */
+  Value &y = grid.ytop;
+  Value &ymin_rnd = grid.ybottom;
+  long long axis; // The row of y = 0
+  long long nrows;
+  if constexpr (std::is_integral<Value>::value){
+    // Computed exactly: wide values (e.g. int64_t) rounded to a step, or
+    // their span, may not fit a Value
+    // Round ymax up to a multiple of ystep
+    __int128 top = ymax;
+    if(top%ystep != 0) top += ystep - top%ystep;
+    // Round ymin down to a multiple of ystep
+    __int128 bottom = ymin;
+    if(ymin%ystep != 0){
+      if(ymin < 0) bottom -= ystep + ymin%ystep;
+      else bottom -= ymin%ystep;
+    }
+    if(top > std::numeric_limits<Value>::max() ||
+       bottom < std::numeric_limits<Value>::min()){
+      throw std::logic_error("Limits too large to round to ystep");
+    }
+    y = (Value)top;
+    ymin_rnd = (Value)bottom;
+    const __int128 rows = (top - bottom)/ystep + 1;
+    nrows = (rows > INT_MAX)  ?  (long long)INT_MAX + 1 : (long long)rows;
+    axis = y/ystep;
+  }
+  else{
+    y = std::ceil(ymax/ystep - STEP_EPSILON)*ystep;
+    ymin_rnd = std::floor(ymin/ystep + STEP_EPSILON)*ystep;
+    nrows = std::llround((y - ymin_rnd)/ystep) + 1;
+    axis = std::llround(y/ystep);
+  }
+  // Wide values (e.g. int64_t) can span more rows than can be drawn
+  if(nrows > INT_MAX) throw std::logic_error("Too many rows");
+  grid.nrows = (int)nrows;
+  grid.axis = (int)std::min<long long>(std::max<long long>(axis, -1),
+				       grid.nrows);
+  DEBUG std::cerr << "ylimits: " << ymin_rnd << ", " << y << std::endl;
+
+  /* Columns: column c holds the x-values [xleft + c*xstep, xleft + (c+1)*xstep)
+     where xleft is xmin rounded down to a multiple of xstep */
+  if constexpr (std::is_integral<Value>::value){
+    Value xmin_off_by = xmin%xstep;
+    if(xmin_off_by < 0) xmin_off_by += xstep;
+    if((__int128)xmin - xmin_off_by < std::numeric_limits<Value>::min()){
+      throw std::logic_error("Limits too large to round to xstep");
+    }
+    grid.xleft = xmin - xmin_off_by;
+    if(((__int128)xmax - grid.xleft)/xstep >= LLONG_MAX){
+      throw std::logic_error("Too many columns");
+    }
+  }
+  else grid.xleft = std::floor(xmin/xstep + STEP_EPSILON)*xstep;
+  grid.xcount = steps_from(grid.xleft, xmax, xstep) + 1;
+  grid.braille = BRAILLE && !bar_graph;
+  grid.elided = ELIDE_GAPS && !grid.braille;
+  if(!grid.elided){
+    if(grid.xcount > INT_MAX) throw std::logic_error("Too many columns");
+    grid.ncols = (int)grid.xcount;
+  }
+
+  /* Series */
+  grid.point_chars = series_chars.empty()  ?  std::string(1, POINT_CHAR)
+                                           :  series_chars;
+  grid.nseries = grid.point_chars.size();
+}
+
+// Switches to a dense raster of cells, for plot()
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::begin_dense(){
+  layout();
+  grid.dense = true;
+  grid.row_words = ((std::size_t)grid.ncols*grid.nseries + 63) >> 6;
+  grid.cells.assign((std::size_t)grid.nrows*grid.row_words, 0);
+}
+
+/* Lays out the columns of the graph with each run of empty columns
+   collapsed into a single gap column. Columns are populated by the points
+   drawn within the y limits, or by any point in bar graphs. */
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::elide_gaps(){
+  std::vector<long long> &xcols = grid.xcols;
+  xcols.clear();
+  for(auto it = points.begin(); it != points.end(); ++it){
+    if(!(it -> second >= grid.xleft)) continue;
+    const long long c = steps_from(grid.xleft, it -> second, xstep);
+    if(c >= grid.xcount) continue;
+    if constexpr (!bar_graph){
+      const Value pt_y = round_y(it -> first);
+      if(!(pt_y <= grid.ytop && pt_y >= grid.ybottom)) continue;
     }
+    xcols.push_back(c);
   }
+  std::sort(xcols.begin(), xcols.end());
+  xcols.erase(std::unique(xcols.begin(), xcols.end()), xcols.end());
 
+  // Assign each populated column its place, leaving a column for each gap
+  grid.vis.resize(xcols.size());
+  grid.col_x.clear();
+  grid.col_gap.clear();
+  for(std::size_t k = 0; k < xcols.size(); ++k){
+    if(k > 0 && xcols[k] - xcols[k - 1] > 1){
+      grid.col_x.push_back(x_at(xcols[k - 1] + 1));
+      grid.col_gap.push_back(true);
+    }
+    grid.vis[k] = grid.col_x.size();
+    grid.col_x.push_back(x_at(xcols[k]));
+    grid.col_gap.push_back(false);
+  }
+  grid.ncols = grid.col_x.size();
+  DEBUG std::cerr << "elided gaps: " << xcols.size() << " populated of "
+		  << grid.xcount << " columns\n";
+}
 
+// Finds the column x is drawn in, or -1 if it is not drawn
+template <typename Value, graph_kind Kind>
+int basic_asciigraph<Value, Kind>::column(const Value x) const {
+  if(!(x >= grid.xleft)) return -1;
+  const long long c = steps_from(grid.xleft, x, xstep);
+  if(c >= grid.xcount) return -1;
+  if(!grid.elided) return (int)c;
+  auto it = std::lower_bound(grid.xcols.begin(), grid.xcols.end(), c);
+  if(it == grid.xcols.end() || *it != c) return -1;
+  return grid.vis[it - grid.xcols.begin()];
+}
 
-  /* Before graphing, sort the points into (1) y-descending, (2) x-ascending */
-  std::sort(graphpoints.begin(), graphpoints.end(), descending_y_order());
+// The first x-value in column c
+template <typename Value, graph_kind Kind>
+typename basic_asciigraph<Value, Kind>::wide
+basic_asciigraph<Value, Kind>::column_x(const int c) const {
+  return grid.elided  ?  grid.col_x[c] : x_at(c);
+}
 
+// The first x-value of the c'th step of xstep from xleft
+template <typename Value, graph_kind Kind>
+typename basic_asciigraph<Value, Kind>::wide
+basic_asciigraph<Value, Kind>::x_at(const long long c) const {
+  if constexpr (std::is_integral<Value>::value){
+    // Exact, as c*xstep alone may not fit (when xleft is negative)
+    return (wide)((__int128)grid.xleft + (__int128)c*xstep);
+  }
+  else return grid.xleft + (wide)c*xstep;
+}
 
-  /* Round graph limits */
-  int &y = *_y;
-  int &ymin_rnd = *_ymin_rnd;
-  // Round ymax up to a multiple of ystep
-  y = ymax;
-  if(y%ystep != 0) y += ystep - y%ystep;
-  // Round ymin down to a multiple of ystep
-  ymin_rnd = ymin;
-  if(ymin%ystep != 0){
-    if(ymin < 0) ymin_rnd -= ystep + ymin%ystep;
-    else ymin_rnd -= ymin%ystep;
+// The y-value of row r
+template <typename Value, graph_kind Kind>
+Value basic_asciigraph<Value, Kind>::row_y(const int r) const {
+  if constexpr (std::is_integral<Value>::value){
+    return (Value)((__int128)grid.ytop - (__int128)r*ystep);
   }
-  DEBUG std::cerr << "ylimits: " << ymin_rnd << ", " << y << std::endl;
+  // Counted in whole steps, so that row y = 0 is exactly 0
+  else return (std::round(grid.ytop/ystep) - r)*ystep;
+}
 
-  return graphpoints;
+// The row of y, a multiple of ystep within the rounded limits
+template <typename Value, graph_kind Kind>
+int basic_asciigraph<Value, Kind>::row_of(const Value y) const {
+  if constexpr (std::is_integral<Value>::value){
+    return (int)(((__int128)grid.ytop - y)/ystep);
+  }
+  else return (int)std::llround((grid.ytop - y)/ystep);
+}
+
+// Rounds y to the nearest multiple of ystep
+template <typename Value, graph_kind Kind>
+Value basic_asciigraph<Value, Kind>::round_y(Value y) const {
+  if constexpr (!std::is_integral<Value>::value){
+    // Halves are rounded up, as for integers
+    return std::floor(y/ystep + 0.5)*ystep;
+  }
+  else{
+    Value pt_off_by = y%ystep;
+    if(pt_off_by != 0){
+      DEBUG std::cerr << "Rounded " << y << " to ";
+      // Round the y-value to nearest multiple of ystep (exactly, as it
+      // may not fit a Value: then it is beyond any limit, and clamped)
+      __int128 rnd = y;
+      if(y > 0){
+	rnd += (pt_off_by < ystep/2)  ?  -pt_off_by  :  ystep - pt_off_by;
+      }
+      else{
+	rnd += (pt_off_by >= -ystep/2)  ?  -pt_off_by  :  -(ystep + pt_off_by);
+      }
+      y = (rnd > std::numeric_limits<Value>::max())  ?
+	  std::numeric_limits<Value>::max() :
+	  (rnd < std::numeric_limits<Value>::min())  ?
+	  std::numeric_limits<Value>::min() : (Value)rnd;
+      DEBUG std::cerr << y << "\n";
+    }
+    return y;
+  }
 }
 
 // Prints x-axis labels
-void asciigraph::label_x_axis(std::ostream &out){
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::label_x_axis(graph_sink &out){
+  if(grid.elided){
+    label_elided_x_axis(out);
+    return;
+  }
+  if(grid.braille){
+    label_braille_x_axis(out);
+    return;
+  }
+  const int pad = std::max(WIDTH_PAD - 1, 0);
+  /* Wide graphs (e.g. bar graphs of many bars) are written out a batch
+     at a time, so that the axis is never held in memory whole */
   // Print bottom border
-  out << "          ";
-  for (int x = xmin; x <= xmax; ++x){
-    out << make_str("-", 1 + WIDTH_PAD);
+  row.assign(10, ' ');
+  std::size_t border = (std::size_t)grid.ncols*std::max(1 + WIDTH_PAD, 0);
+  while(border > 0){
+    const std::size_t n = std::min<std::size_t>(border, RENDER_BATCH_SIZE);
+    row.append(n, '-');
+    border -= n;
+    if(row.size() >= RENDER_BATCH_SIZE){
+      write_out(out, row);
+      row.clear();
+    }
   }
   // Print labels
-  out << "\n          ";
-  for(int x = xmin; x <= xmax; x += X_LABEL_DENSITY){
-    if(0 <= x && x <= 9){ // 1 char label
-      out << x;
-      for(int i = 1; i < X_LABEL_DENSITY*2; ++i){
-	out << " ";
-      }
-      out << make_str(" ", WIDTH_PAD - 1);
+  row += "\n          ";
+  for(int c = 0; c < grid.ncols; c += X_LABEL_DENSITY){
+    // Labels only grow wider from here on, too wide to show
+    if(column_x(c) >= 10000) break;
+    char label[32];
+    const int len = format_value(label, sizeof(label), column_x(c));
+    if(len > 4) continue; // Too wide to label
+    row.append(label, len);
+    row.append(std::max(X_LABEL_DENSITY*2 - len, 0) + pad, ' ');
+    if(row.size() >= RENDER_BATCH_SIZE){
+      write_out(out, row);
+      row.clear();
     }
-    else if((10 <= x && x <= 99) || (-9 <= x && x <= -1)){ // 2 char
-      out << x;
-      for(int i = 2; i < X_LABEL_DENSITY*2; ++i){
-	out << " ";
-      }
-      out << make_str(" ", WIDTH_PAD - 1);
+  }
+  row += "\n          ";
+  row += X_AXIS_LABEL;
+  write_out(out, row);
+}
+
+// Prints the legend (if any) after the x-axis label, a batch at a time
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::write_legend(graph_sink &out){
+  if(legend == nullptr) return;
+  row = "\n\n== LEGEND ==";
+  for(std::size_t i = 0; i < legend -> size(); ++i){
+    char num[24];
+    const int len = std::snprintf(num, sizeof(num), "\n%lld =",
+				  (long long)legend -> x(i));
+    row.append(num, len);
+    const std::string_view label = (*legend)[i];
+    row.append(label.data(), label.size());
+    if(row.size() >= RENDER_BATCH_SIZE){
+      write_out(out, row);
+      row.clear();
+    }
+  }
+  write_out(out, row);
+}
+
+// Prints x-axis labels for graphs with elided gaps
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::label_elided_x_axis(graph_sink &out){
+  const int cell = 1 + std::max(WIDTH_PAD, 0);
+  // Print bottom border, marking the gaps
+  row.assign(10, ' ');
+  for(int c = 0; c < grid.ncols; ++c){
+    row += grid.col_gap[c]  ?  GAP_CHAR : '-';
+    row.append(cell - 1, '-');
+  }
+  // Print labels on every X_LABEL_DENSITY'th column, skipping any which
+  // would run into the previous label
+  row += "\n          ";
+  const std::size_t base = row.size();
+  std::size_t next = base;
+  for(int c = 0; c < grid.ncols; c += X_LABEL_DENSITY){
+    const std::size_t at = base + (std::size_t)c*cell;
+    if(grid.col_gap[c] || at < next) continue;
+    row.append(at - row.size(), ' ');
+    char buf[32];
+    const int len = format_value(buf, sizeof(buf), grid.col_x[c]);
+    row.append(buf, len);
+    next = row.size() + 1;
+  }
+  row += "\n          ";
+  row += X_AXIS_LABEL;
+  write_out(out, row);
+}
+
+// Prints x-axis labels for Braille graphs, each char showing two columns
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::label_braille_x_axis(graph_sink &out){
+  const int chars = (grid.ncols + 1)/2;
+  // Print bottom border
+  row.assign(10, ' ');
+  row.append(chars, '-');
+  // Print the first x-value of every X_LABEL_DENSITY'th char, skipping any
+  // which would run into the previous label
+  row += "\n          ";
+  const std::size_t base = row.size();
+  std::size_t next = base;
+  for(int k = 0; k < chars; k += X_LABEL_DENSITY){
+    const std::size_t at = base + k;
+    if(at < next) continue;
+    row.append(at - row.size(), ' ');
+    char buf[32];
+    const int len = format_value(buf, sizeof(buf), column_x(2*k));
+    row.append(buf, len);
+    next = row.size() + 1;
+  }
+  row += "\n          ";
+  row += X_AXIS_LABEL;
+  write_out(out, row);
+}
+
+// Builds the cell templates used to fill in rows without points
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::build_row_templates(){
+  const std::size_t cell = 1 + std::max(WIDTH_PAD, 0);
+  const std::size_t len = (std::size_t)grid.ncols*cell;
+  blank_row.assign(len, ' ');
+  guide_row.assign(len, ' ');
+  axis_row.assign(len, ' ');
+  // Guidelines fall on every X_LABEL_DENSITY'th multiple of xstep, or on
+  // every X_LABEL_DENSITY'th column when gaps are elided
+  const long long xleft_steps = grid.elided  ?  0 :
+                                steps_from((Value)0, grid.xleft, xstep);
+  for(int c = 0; c < grid.ncols; ++c){
+    std::size_t off = (std::size_t)c*cell;
+    if(grid.elided && grid.col_gap[c]){
+      axis_row[off] = GAP_CHAR;
+      continue;
     }
-    else if((100 <= x && x <= 999) || (-99 <= x && x <= -10)){ // 3 char
-      out << x;
-      for(int i = 3; i < X_LABEL_DENSITY*2; ++i){
-	out << " ";
+    axis_row[off] = X_AXIS_CHAR;
+    if((xleft_steps + c)%X_LABEL_DENSITY == 0) guide_row[off] = GUIDELINE_CHAR;
+  }
+  row.reserve(len + 32);
+
+  // Marked rows are drawn with MARK_CHAR in every cell
+  mark_rows.clear();
+  if(marks.empty()) return;
+  mark_row.assign(len, ' ');
+  for(int c = 0; c < grid.ncols; ++c){
+    if(grid.elided && grid.col_gap[c]) continue;
+    mark_row[(std::size_t)c*cell] = MARK_CHAR;
+  }
+  for(std::size_t i = 0; i < marks.size(); ++i){
+    const Value y = round_y(marks[i].first);
+    if(!(y <= grid.ytop && y >= grid.ybottom)) continue;
+    mark_rows.push_back(std::make_pair(row_of(y), i));
+  }
+  std::sort(mark_rows.begin(), mark_rows.end());
+}
+
+// Are any of the rows [from, to) marked?
+template <typename Value, graph_kind Kind>
+bool basic_asciigraph<Value, Kind>::marked(const int from,
+					   const int to) const {
+  auto it = std::lower_bound(mark_rows.begin(), mark_rows.end(),
+			     std::make_pair(from, (std::size_t)0));
+  return it != mark_rows.end() && it -> first < to;
+}
+
+// Ends a row of buf with the labels of the marks in rows [from, to)
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::end_row(std::string &buf, const int from,
+					    const int to) const {
+  auto it = std::lower_bound(mark_rows.begin(), mark_rows.end(),
+			     std::make_pair(from, (std::size_t)0));
+  for(; it != mark_rows.end() && it -> first < to; ++it){
+    buf += ' ';
+    buf += marks[it -> second].second;
+  }
+  buf += '\n';
+}
+
+// Starts a new row in buf with the y-axis label for y
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::begin_row(std::string &buf,
+					      const Value y) const {
+  char label[32];
+  const int len = format_value(label, sizeof(label), y);
+  // Label padding: labels are right aligned to 8 chars
+  buf.append(std::max(8 - len, 0), ' ');
+  buf.append(label, len); // y-axis label
+  buf += ' ';
+  buf += Y_AXIS_CHAR; // Y-axis line
+}
+
+// Appends the cells for columns [from, to) of row r to buf
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::fill_cells(std::string &buf,
+					       const int from, const int to,
+					       const int r,
+					       const std::string &tmpl) const {
+  if(from >= to) return;
+  const int cell = 1 + std::max(WIDTH_PAD, 0);
+  const std::size_t start = buf.size();
+  buf.append(tmpl, (std::size_t)from*cell, (std::size_t)(to - from)*cell);
+  if constexpr (bar_graph){
+    if(r == grid.axis) return;
+    const bool above = r < grid.axis;
+    for(int c = from; c < to; ++c){
+      // if this column has bar ON, print the bar on its side of the x-axis
+      const bool on = above  ?  r >= grid.bar_from[c] : r < grid.bar_to[c];
+      const bool off = above  ?  r < grid.bar_to[c] : r < grid.blank_to[c];
+      if(on) buf[start + (std::size_t)(c - from)*cell] = POINT_CHAR;
+      else if(off) buf[start + (std::size_t)(c - from)*cell] = ' ';
+    }
+  }
+}
+
+// Appends a single cell (c followed by the width padding) to buf
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::put_cell(std::string &buf,
+					     const char c) const {
+  buf += c;
+  buf.append(std::max(WIDTH_PAD, 0), ' ');
+}
+
+/* Appends Braille text rows [first, last) of the graph to buf; bits must be
+   all 0 and hold a bitmap of the columns for each of the four rows of dots.
+   Each char is U+2800 plus its dots, written as UTF-8: the bits 0x01, 0x02,
+   0x04 and 0x40 are the dots of the left column from the top down, and
+   0x08, 0x10, 0x20 and 0x80 those of the right. */
+template <typename Value, graph_kind Kind>
+void basic_asciigraph<Value, Kind>::render_braille_rows(const int first,
+							const int last,
+							std::string &buf,
+							std::vector<uint64_t> &bits) const {
+  const std::size_t words = bits.size()/4;
+  const int chars = (grid.ncols + 1)/2;
+  const int ns = grid.nseries;
+  for(int t = first; t < last; ++t){
+    const char blank = marked(4*t, 4*t + 4)  ?  MARK_CHAR : ' ';
+    begin_row(buf, row_y(4*t));
+
+    /* Mark the dots of the points in the four rows (series alike) */
+    for(int j = 0; j < 4 && 4*t + j < grid.nrows; ++j){
+      const int r = 4*t + j;
+      uint64_t *dots = bits.data() + j*words;
+      if(grid.dense){
+	const uint64_t *cells = grid.cells.data() + r*grid.row_words;
+	for(std::size_t w = 0; w < grid.row_words; ++w){
+	  if(ns == 1){
+	    dots[w] |= cells[w];
+	    continue;
+	  }
+	  for(uint64_t set = cells[w]; set != 0; set &= set - 1){
+	    const int c = ((int)(w << 6) + __builtin_ctzll(set))/ns;
+	    dots[c >> 6] |= (uint64_t)1 << (c & 63);
+	  }
+	}
+      }
+      for(std::size_t i = grid.row_start[r]; i < grid.row_start[r + 1]; ++i){
+	const int c = (int)points[i].second/ns;
+	dots[c >> 6] |= (uint64_t)1 << (c & 63);
       }
-      out << make_str(" ", WIDTH_PAD - 1);
     }
-    else if((1000 <= x && x <= 9999) || (-999 <= x && x <= -100)){ // 4 char
-      out << x;
-      for(int i = 4; i < X_LABEL_DENSITY*2; ++i){
-	out << " ";
+
+    /* Draw the chars, 32 to each word of the bitmaps */
+    for(std::size_t w = 0; w < words; ++w){
+      const uint64_t d0 = bits[w], d1 = bits[words + w],
+	             d2 = bits[2*words + w], d3 = bits[3*words + w];
+      const int n = std::min<long long>(32, chars - 32*(long long)w);
+      if((d0 | d1 | d2 | d3) == 0){
+	buf.append(n, blank);
+	continue;
       }
-      out << make_str(" ", WIDTH_PAD - 1);
+      for(int k = 0; k < n; ++k){
+	const int b = 2*k;
+	const unsigned dots = (d0 >> b & 1)             | (d1 >> b & 1) << 1 |
+	                      (d2 >> b & 1) << 2        |
+	                      (d0 >> (b + 1) & 1) << 3  |
+	                      (d1 >> (b + 1) & 1) << 4  |
+	                      (d2 >> (b + 1) & 1) << 5  |
+	                      (d3 >> b & 1) << 6        |
+	                      (d3 >> (b + 1) & 1) << 7;
+	if(dots == 0){
+	  buf += blank;
+	  continue;
+	}
+	buf += '\xE2';
+	buf += (char)(0xA0 | dots >> 6);
+	buf += (char)(0x80 | (dots & 0x3F));
+      }
+      bits[w] = bits[words + w] = bits[2*words + w] = bits[3*words + w] = 0;
     }
+    end_row(buf, 4*t, 4*t + 4);
   }
-  out << std::endl << "          " << X_AXIS_LABEL;
 }
 
+template class basic_asciigraph<int, SCATTER_GRAPH>;
+template class basic_asciigraph<int, BAR_GRAPH>;
+template class basic_asciigraph<int64_t, SCATTER_GRAPH>;
+template class basic_asciigraph<int64_t, BAR_GRAPH>;
+template class basic_asciigraph<double, SCATTER_GRAPH>;
+template class basic_asciigraph<double, BAR_GRAPH>;
+
 // Creates a string composed to n*str
 std::string make_str(std::string str, const int n,
 		     std::string separator /* = "" */){
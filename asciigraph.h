@@ -11,7 +11,14 @@
 #include <algorithm>
 #include <iostream>
 #include <utility>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <type_traits>
+#include <stdexcept>
+#include <unordered_map>
 #include "asciigraph_except.h"
+#include "stats.h"
 
 
 // Change these to adjust how the graph appears by default...
@@ -25,19 +32,77 @@
 #define Y_AXIS_LABEL_DEFAULT      "y-axis"
 #define WIDTH_PAD_DEFAULT         1
 #define BAR_ZERO_POINT_DEFAULT    false
+#define ELIDE_GAPS_DEFAULT        false
+#define GAP_CHAR_DEFAULT          '~'
+#define BRAILLE_DEFAULT           false
+#define MARK_CHAR_DEFAULT         '.'
+#define SERIES_CHARS_DEFAULT      "*+ox%&="  // Series after the first
 
+// The most series which can be overlaid in one graph
+#define SERIES_MAX 16
 
-/* Class asciigraph:
+// Rows drawn are written out in pieces of about this many bytes
+#define RENDER_BATCH_SIZE (64 << 10)
+
+class graph_sink;
+
+/* enum graph_kind:
+   The kinds of graph drawn, which are fixed when a graph type is compiled.
+*/
+enum graph_kind {
+  SCATTER_GRAPH,  // Points (basic and scatter data)
+  BAR_GRAPH       // A bar from the x-axis to each point
+};
+
+/* Class label_pool:
+   Labels (e.g. the legend of a bar graph) stored end to end in a single
+   buffer and found by their offsets, so that a great many labels take
+   little more memory than their text, and no allocation each. Each label
+   is kept with the x-value of what it labels (e.g. its bar).
+*/
+class label_pool {
+public:
+  void clear(){
+    text.clear();
+    ends.clear();
+    xs.clear();
+  }
+  void add(std::string_view label, const int64_t x){
+    text.append(label.data(), label.size());
+    ends.push_back(text.size());
+    xs.push_back(x);
+  }
+  std::size_t size() const { return ends.size(); }
+  std::string_view operator[](const std::size_t i) const {
+    const std::size_t begin = (i == 0)  ?  0 : ends[i - 1];
+    return std::string_view(text.data() + begin, ends[i] - begin);
+  }
+  int64_t x(const std::size_t i) const { return xs[i]; }
+
+private:
+  std::string text;
+  std::vector<std::size_t> ends;        // Of each label in text
+  std::vector<int64_t> xs;              // The x-value of each label
+};
+
+/* Class basic_asciigraph:
    A tool to graph arbitrary data in plain text.
+   Value is the type of the x- and y-values of the points, limits and steps
+   (int, int64_t or double; see the explicit instantiations in
+   asciigraph.cpp) and Kind the kind of graph drawn. The code drawing each
+   kind of graph is specialized at compile time. asciigraph and
+   bar_asciigraph are the int graphs.
  */
-class asciigraph {
+template <typename Value, graph_kind Kind = SCATTER_GRAPH>
+class basic_asciigraph {
 public:
+  typedef std::pair<Value, Value> point;
+
   /* asciigraph::Constructor:
      Creates an asciigraph object with the given points, x/y constrains,
      and steps.
      The points should be given as pairs (x, y) where x is the independent
      variable and y is the depended variable.
-     * Note that xstep currently does nothing.
 
      == A note on steps ==
      The step parameters dictate the resolution of the graph in the specified
@@ -61,20 +126,33 @@ public:
      is therefore lost in the process, this is often desirable when dealing
      with large, sparse data points so as to keep the graph managably sized
      and reasonable to read.
-n    =====================
+     The xstep parameter works likewise for columns: each displayed column
+     contains the data for xstep x-values, starting from xmin rounded down
+     to a multiple of xstep. Points sharing a column are all plotted in it.
+     With ELIDE_GAPS, each run of columns without any points is displayed
+     as a single column marked with GAP_CHAR, so sparse data (e.g. epoch
+     timestamps) is only as wide as its populated columns.
+     With BRAILLE, scatter graphs are drawn in Unicode Braille chars
+     (UTF-8), each holding a 2 x 4 grid of dots: every char shows two
+     columns and four rows, labelled with the y-value of its top row, so
+     the graph takes an eighth of the cells. Series are then drawn alike
+     and WIDTH_PAD, guidelines, the x-axis and ELIDE_GAPS are not drawn.
+     With a floating point Value, steps need not be whole numbers: each
+     row then holds the y-values nearest to its multiple of ystep, and
+     each column the x-values in [xleft + c*xstep, xleft + (c+1)*xstep).
+     =====================
 
      @throws
      std::logic_error                         Given limits invalid
 
      @params
-     std::vector<std::pair<int, int>> Fx      The points to be graphed
-     int _xmin                                The lower bound of the x-axis
-     int _xmax                                The upper bound of the x-axis
-     int _xstep                               The step of the x-axis
-                                              * This does nothing
-     int _ymin                                The lower bound of the y-axis
-     int _ymax                                The upper bound of the y-axis
-     int _ystep                               The step of the y-axis
+     const std::vector<...> &Fx               The points to be graphed (copied)
+     Value _xmin                              The lower bound of the x-axis
+     Value _xmax                              The upper bound of the x-axis
+     Value _xstep                             The step of the x-axis
+     Value _ymin                              The lower bound of the y-axis
+     Value _ymax                              The upper bound of the y-axis
+     Value _ystep                             The step of the y-axis
      bool _debug             = false          Log debug info to stderr?
      char _X_AXIS_CHAR       = ..._DEFAULT    Char to use for drawing x-axis
      char _Y_AXIS_CHAR       = ..._DEFAULT    Char to use for drawing y-axis
@@ -84,10 +162,35 @@ n    =====================
      int  _GUIDELINE_DENSITY = ..._DEFAULT    Interval to print guidelines
      int  _WIDTH_PAD         = ..._DEFAULT    Number of spaces between columns
      bool _BAR_ZERO_POINT    = ..._DEFAULT    Bar graphs: print points on zero?
+     bool _ELIDE_GAPS        = ..._DEFAULT    Collapse runs of empty columns?
+     char _GAP_CHAR          = ..._DEFAULT    Char marking collapsed columns
+     bool _BRAILLE           = ..._DEFAULT    Scatter graphs: draw Braille dots?
+  */
+  basic_asciigraph(const std::vector<point> &Fx,
+	     const Value _xmin, const Value _xmax, const Value _xstep,
+	     const Value _ymin, const Value _ymax, const Value _ystep,
+	     const bool _debug = false,
+	     const char _X_AXIS_CHAR         = X_AXIS_CHAR_DEFAULT,
+	     const char _Y_AXIS_CHAR         = Y_AXIS_CHAR_DEFAULT,
+	     const char _GUIDELINE_CHAR      = GUIDELINE_CHAR_DEFAULT,
+	     const char _POINT_CHAR          = POINT_CHAR_DEFAULT,
+	     const int  _X_LABEL_DENSITY     = X_LABEL_DENSITY_DEFAULT,
+	     const int _GUIDELINE_DENSITY    = GUIDELINE_DENSITY_DEFAULT,
+	     const std::string &_X_AXIS_LABEL = X_AXIS_LABEL_DEFAULT,
+	     const std::string &_Y_AXIS_LABEL = Y_AXIS_LABEL_DEFAULT,
+	     const int _WIDTH_PAD            = WIDTH_PAD_DEFAULT,
+	     const bool _BAR_ZERO_POINT      = BAR_ZERO_POINT_DEFAULT,
+	     const bool _ELIDE_GAPS          = ELIDE_GAPS_DEFAULT,
+	     const char _GAP_CHAR            = GAP_CHAR_DEFAULT,
+	     const bool _BRAILLE             = BRAILLE_DEFAULT);
+
+  /* asciigraph::Constructor (taking the points):
+     As above, but the graph takes over the memory of the points instead
+     of copying them, leaving Fx empty.
   */
-  asciigraph(const std::vector<std::pair<int, int>> Fx,
-	     const int _xmin, const int _xmax, const int _xstep,
-	     const int _ymin, const int _ymax, const int _ystep,
+  basic_asciigraph(std::vector<point> &&Fx,
+	     const Value _xmin, const Value _xmax, const Value _xstep,
+	     const Value _ymin, const Value _ymax, const Value _ystep,
 	     const bool _debug = false,
 	     const char _X_AXIS_CHAR         = X_AXIS_CHAR_DEFAULT,
 	     const char _Y_AXIS_CHAR         = Y_AXIS_CHAR_DEFAULT,
@@ -95,30 +198,343 @@ n    =====================
 	     const char _POINT_CHAR          = POINT_CHAR_DEFAULT,
 	     const int  _X_LABEL_DENSITY     = X_LABEL_DENSITY_DEFAULT,
 	     const int _GUIDELINE_DENSITY    = GUIDELINE_DENSITY_DEFAULT,
-	     const std::string _X_AXIS_LABEL = X_AXIS_LABEL_DEFAULT,
-	     const std::string _Y_AXIS_LABEL = Y_AXIS_LABEL_DEFAULT,
+	     const std::string &_X_AXIS_LABEL = X_AXIS_LABEL_DEFAULT,
+	     const std::string &_Y_AXIS_LABEL = Y_AXIS_LABEL_DEFAULT,
 	     const int _WIDTH_PAD            = WIDTH_PAD_DEFAULT,
-	     const bool _BAR_ZERO_POINT      = BAR_ZERO_POINT_DEFAULT);
+	     const bool _BAR_ZERO_POINT      = BAR_ZERO_POINT_DEFAULT,
+	     const bool _ELIDE_GAPS          = ELIDE_GAPS_DEFAULT,
+	     const char _GAP_CHAR            = GAP_CHAR_DEFAULT,
+	     const bool _BRAILLE             = BRAILLE_DEFAULT);
+
+
+  /* reset() (limits):
+     Sets new limits and steps for the graph and removes its points,
+     keeping the other settings. The memory of the graph's points and
+     buffers is kept for reuse, so one object can draw many graphs.
+
+     @throws
+     std::logic_error                         Given limits invalid
+
+     @params
+     (The limits and steps, as for the constructor)
+
+     @return
+     void
+  */
+  void reset(const Value _xmin, const Value _xmax, const Value _xstep,
+	     const Value _ymin, const Value _ymax, const Value _ystep);
+
+  /* reset() (all settings):
+     As reset() (limits), also replacing every other setting.
+
+     @throws
+     std::logic_error                         Given limits invalid
+
+     @params
+     (As for the constructor, without the points)
+
+     @return
+     void
+  */
+  void reset(const Value _xmin, const Value _xmax, const Value _xstep,
+	     const Value _ymin, const Value _ymax, const Value _ystep,
+	     const bool _debug,
+	     const char _X_AXIS_CHAR, const char _Y_AXIS_CHAR,
+	     const char _GUIDELINE_CHAR, const char _POINT_CHAR,
+	     const int _X_LABEL_DENSITY, const int _GUIDELINE_DENSITY,
+	     const std::string &_X_AXIS_LABEL,
+	     const std::string &_Y_AXIS_LABEL,
+	     const int _WIDTH_PAD, const bool _BAR_ZERO_POINT,
+	     const bool _ELIDE_GAPS, const char _GAP_CHAR,
+	     const bool _BRAILLE);
 
+  /* clear():
+     Removes the graph's points, keeping their memory for reuse.
+  */
+  void clear(){
+    points.clear();
+    series.clear();
+    cell_counts.clear();
+    grid.dense = false;
+    grid.prepared = false;
+  }
+
+  /* reserve():
+     Makes room for n points, so that adding them does not reallocate.
+
+     @params
+     const std::size_t n
+  */
+  void reserve(const std::size_t n){ points.reserve(n); }
+
+  /* setPoints():
+     Replaces the points of the graph with Fx, taking over its memory
+     instead of copying it. Fx is left holding the memory of the graph's
+     previous points, emptied, so that two vectors can be traded back and
+     forth between graphs without reallocating either.
+
+     @params
+     std::vector<point> &&Fx    The points (x, y) to graph
+
+     @return
+     void
+  */
+  void setPoints(std::vector<point> &&Fx);
+
+  /* setPoints() (series):
+     As setPoints(), the points belonging to overlaid series (see
+     setSeries()): point Fx[i] is of series S[i]. S is likewise traded
+     for the memory of the graph's previous series.
+
+     @params
+     std::vector<point> &&Fx          The points (x, y) to graph
+     std::vector<uint8_t> &&S         The series of each point
+
+     @return
+     void
+  */
+  void setPoints(std::vector<point> &&Fx, std::vector<uint8_t> &&S);
+
+  /* setPoints() (span):
+     Replaces the points of the graph with a copy of the n points (x, y)
+     starting at Fx.
+
+     @params
+     const point *Fx
+     const std::size_t n
+
+     @return
+     void
+  */
+  void setPoints(const point *Fx, const std::size_t n);
   
   /* addPoint():
      Adds the given point to the list of points to be graphed.
 
      @params
-     std::pair<int, int> p
+     point p
+
+     @return
+     bool 
+  */
+  bool addPoint(point p){
+    try{
+      points.push_back(point(p.second, p.first));
+      if(!series.empty()) series.push_back(0);
+      return true;
+    }catch(const std::bad_alloc &e){
+      return false;
+    }
+  }
+
+  /* addPoint() (series):
+     As addPoint(), adding the point to the given series.
+
+     @params
+     point p
+     const unsigned s
 
      @return
      bool 
   */
-  bool addPoint(std::pair<int, int> p){
+  bool addPoint(point p, const unsigned s){
+    if(s == 0) return addPoint(p);
     try{
-      points.push_back(std::pair<int, int>(p.second, p.first));
+      series.resize(points.size(), 0); // Points so far are of series 0
+      points.push_back(point(p.second, p.first));
+      series.push_back(s);
       return true;
-    }catch(std::bad_alloc e){
+    }catch(const std::bad_alloc &e){
       return false;
     }
   }
 
+  /* setSeries():
+     Overlays several series of points in the graph, drawing the points
+     of series s with the char chars[s]. Where points of several series
+     share a cell, the char of the first of them is drawn. Points of
+     series without a char are not drawn. Without series (chars empty,
+     as by default and after reset() (all settings)) every point is drawn
+     with POINT_CHAR. Points plot()ted before are dropped.
+     All series are drawn in a single pass: the cost is that of drawing
+     one graph of all of their points.
+
+     @throws
+     std::logic_error                         More than SERIES_MAX series
+
+     @params
+     const std::string &chars                 The char of each series
+
+     @return
+     void
+  */
+  void setSeries(const std::string &chars){
+    if(chars.size() > SERIES_MAX){
+      throw std::logic_error("Too many series");
+    }
+    series_chars = chars;
+    grid.dense = false;
+  }
+
+  /* markRows():
+     Draws a labelled guide row across the graph at each of the given
+     y-values (e.g. percentiles of the data), in the row the y-value is
+     rounded to as for points. The empty cells of the row are drawn with
+     c and its label follows the row. Marks outside of the graph are not
+     drawn. Marks are removed by reset() (all settings).
+
+     @params
+     const std::vector<...> &_marks           The (y, label) of each mark
+     const char c = MARK_CHAR_DEFAULT         Char to draw marked rows with
+
+     @return
+     void
+  */
+  void markRows(const std::vector<std::pair<Value, std::string>> &_marks,
+		const char c = MARK_CHAR_DEFAULT){
+    marks = _marks;
+    MARK_CHAR = c;
+  }
+
+  /* setLegend():
+     Draws a legend after the x-axis label: a "== LEGEND ==" line, then a
+     line "x =label" for each label of the pool, x being the x-value it
+     labels (its bar's column, as on the x-axis). The legend is written
+     out as it is drawn, a batch of lines at a time, so it is never held
+     in memory again. The pool is not copied, and must outlive drawing.
+     The legend is removed by reset() (all settings).
+
+     @params
+     const label_pool *labels                 The labels, or null for none
+
+     @return
+     void
+  */
+  void setLegend(const label_pool *labels){ legend = labels; }
+
+  /* plot():
+     Rasterizes the given point straight into the graph's cells instead of
+     storing it, so that graphs of any number of points take memory
+     proportional only to the size of the graph. Points outside of the
+     limits are dropped. Plotted points cannot be drawn as bars; with
+     ELIDE_GAPS (and not BRAILLE) the point is stored as by addPoint(),
+     since the columns shown depend on every point. Series must be set
+     before plotting.
+
+     @params
+     const Value x
+     const Value y
+     const unsigned s     = 0     The series of the point
+
+     @return
+     int                          The row drawn with the point (as for
+                                  drawRows()), or -1 if it is not drawn
+                                  or is stored
+  */
+  int plot(const Value x, const Value y, const unsigned s = 0){
+    if(ELIDE_GAPS && !BRAILLE){
+      addPoint(point(x, y), s);
+      return -1;
+    }
+    if(!grid.dense) begin_dense();
+    const int c = column(x);
+    const Value pt_y = round_y(y);
+    if(stats && pt_y != y) ++stats -> rounded;
+    if(c < 0 || s >= (unsigned)grid.nseries ||
+       !(pt_y <= grid.ytop && pt_y >= grid.ybottom)){
+      if(stats) ++stats -> outside;
+      return -1;
+    }
+    const std::size_t r = row_of(pt_y);
+    const std::size_t i = (std::size_t)c*grid.nseries + s;
+    uint64_t &word = grid.cells[r*grid.row_words + (i >> 6)];
+    const uint64_t bit = (uint64_t)1 << (i & 63);
+    if(stats && (word & bit)) ++stats -> duplicates;
+    word |= bit;
+    if(counting) ++cell_counts[r*(grid.row_words << 6) + i];
+    return grid.braille  ?  (int)r/4 : (int)r;
+  }
+
+  /* count_cells():
+     Has plot() count the points plotted into each cell, so that they can
+     be taken out again by unplot() (e.g. as they leave a sliding window).
+     Off by default, and after reset() (all settings).
+
+     @params
+     const bool on
+
+     @return
+     void
+  */
+  void count_cells(const bool on){
+    counting = on;
+    cell_counts.clear();
+  }
+
+  /* unplot():
+     Takes a point plot()ted (while counting cells) out of the graph: its
+     cell is drawn empty again once every point plotted in it is taken
+     out. Points never plotted (e.g. outside of the limits) are ignored.
+
+     @params
+     const Value x
+     const Value y
+     const unsigned s     = 0     The series of the point
+
+     @return
+     int                          The row drawn with the point (as for
+                                  drawRows()), or -1 if it was not drawn
+  */
+  int unplot(const Value x, const Value y, const unsigned s = 0);
+
+  /* drawRows():
+     Draws rows [first, last) of the graph (counted from the top, in rows
+     of text) to buf as operator() would, one line each, so that a graph
+     drawn by operator() can be kept up to date as points are plot()ted
+     and unplot()ted by redrawing only the rows they are drawn in. The
+     graph must have been drawn by operator() since it was last reset, and
+     hold only plotted points.
+
+     @throws
+     std::logic_error          The graph is not drawn from plotted points
+
+     @params
+     const int first
+     const int last
+     std::string &buf          The rows are appended to buf
+
+     @return
+     void
+  */
+  void drawRows(const int first, const int last, std::string &buf);
+
+  /* collect_stats():
+     Has graphing count the points rounded, outside of the limits, and
+     dropped as duplicates, and time preparing, rendering and writing the
+     graph, into the given run_stats (or nothing, if null).
+
+     @params
+     run_stats *_stats
+
+     @return
+     void
+  */
+  void collect_stats(run_stats *_stats){ stats = _stats; }
+
+  /* render_in_parallel():
+     Sets whether large graphs may be rendered across shared_pool() (the
+     default). The pool runs one batch at a time, so graphs drawn from
+     several threads at once (e.g. through the C API) are drawn serially,
+     which also keeps rendering from allocating per-thread buffers.
+
+     @params
+     const bool on
+
+     @return
+     void
+  */
+  void render_in_parallel(const bool on){ parallel = on; }
+
   
   /* operator():
      Graphs the data stored in this asciigraph object to the given
@@ -143,7 +559,7 @@ n    =====================
      ==========================
 
      @throws
-     void
+     std::logic_error          More rows or columns than an int can count
      
      @params
      std::ostream &out         The stream to which to print the graoh
@@ -151,31 +567,181 @@ n    =====================
      @return
      void 
   */
-  void operator()(std::ostream &out, const bool bar_graph = false);
+  void operator()(std::ostream &out);
+
+  /* operator() (buffer):
+     Graphs the data into the given buffer, as by operator() (stream).
+     Like snprintf, the whole graph is drawn even if it does not fit, so
+     its size is known: only the first size bytes are stored. No '\0' is
+     added.
+
+     @params
+     char *buf                 The buffer to store the graph in
+     const std::size_t size    The size of buf
+
+     @return
+     std::size_t               The size of the graph, in bytes
+  */
+  std::size_t operator()(char *buf, const std::size_t size);
+
+  /* operator() (file descriptor):
+     Graphs the data to the given file descriptor (e.g. a socket), as by
+     operator() (stream), writing the row buffers drawn straight to it
+     (with writev() where there are several).
+
+     @params
+     const int fd              The file descriptor to write the graph to
+
+     @return
+     bool                      Was the whole graph written?
+  */
+  bool operator()(const int fd);
   
 private:
+  friend class graph_bench; // Times prepare_data() and render() apart
+
+  static constexpr bool bar_graph = Kind == BAR_GRAPH;
+  // Holds x-values computed from column numbers without overflowing
+  typedef typename std::conditional<std::is_integral<Value>::value,
+				    long long, double>::type wide;
+
   /* asciigraph::prepare_data():
-     Prepares asciigraph data for graphing by performing any necessary
-     rounding, transposing the data into (y, x) format, and finally ordering
-     the data into descending order.
+     Prepares asciigraph data for graphing by rounding the limits and the
+     points' y-values to multiples of ystep, then bucketing the points by
+     row (in descending y order) with an in-place counting sort, so that
+     no memory beyond the points themselves is needed (see raster).
+     Also initializes the bar state of each column for bar graphs.
+  */
+  void prepare_data();
+  void draw(graph_sink &out);
+  void render(std::ostream &out);
+  void render(graph_sink &out);
+  void plan_bars();
+  void layout();
+  void begin_dense();
+  void elide_gaps();
+  Value round_y(Value y) const;
+  Value row_y(const int r) const;
+  int row_of(const Value y) const;
+  int column(const Value x) const;
+  wide column_x(const int c) const;
+  wide x_at(const long long c) const;
+  void label_x_axis(graph_sink &out);
+  void label_elided_x_axis(graph_sink &out);
+  void label_braille_x_axis(graph_sink &out);
+  void write_legend(graph_sink &out);
+  void restore_points();
+  void write_out(graph_sink &out, const std::string &buf);
+  std::size_t render_words() const;
+
+  /* Row buffer helpers:
+     Each output row is assembled into a row buffer, filling runs of empty
+     cells from the cached blank/guideline/axis templates. Rows depend only
+     on the raster, so separate buffers can be filled concurrently.
   */
-  std::vector<std::pair<int, int>>
-    prepare_data(const std::vector< std::pair<int, int> > &pts,
-		 int *_y, int *_ymin_rnd);
-  void label_x_axis(std::ostream &out);
+  void build_row_templates();
+  void render_rows(const int first, const int last,
+		   std::string &buf, std::vector<uint64_t> &bits) const;
+  void begin_row(std::string &buf, const Value y) const;
+  void fill_cells(std::string &buf, const int from, const int to,
+		  const int r, const std::string &tmpl) const;
+  bool marked(const int from, const int to) const;
+  void end_row(std::string &buf, const int from, const int to) const;
+  void put_cell(std::string &buf, const char c) const;
+  void render_braille_rows(const int first, const int last,
+			   std::string &buf, std::vector<uint64_t> &bits) const;
 
   
-  int ymin, ymax, ystep, xmin, xmax, xstep;
+  Value ymin, ymax, ystep, xmin, xmax, xstep;
   bool debug;
-  //                   ( y , x )
-  std::vector<std::pair<int, int>> points;
+  //                   ( y , x )  (or ( row , column ) once prepared)
+  std::vector<point> points;
+  std::vector<uint8_t> series;          // Of each point (if not all 0)
+  std::string series_chars;
   char X_AXIS_CHAR, Y_AXIS_CHAR, GUIDELINE_CHAR, POINT_CHAR;
   int X_LABEL_DENSITY, GUIDELINE_DENSITY;
   std::string X_AXIS_LABEL, Y_AXIS_LABEL;
   int WIDTH_PAD;
   bool BAR_ZERO_POINT;
+  bool ELIDE_GAPS;
+  char GAP_CHAR;
+  bool BRAILLE;
+  std::vector<std::pair<Value, std::string>> marks;
+  char MARK_CHAR;
+  const label_pool *legend;
+  run_stats *stats;
+  bool parallel;                        // Render across shared_pool()?
+  bool counting;                        // Count the points of each cell?
+  // The points plotted in each cell (by bit of the raster), if counting
+  std::unordered_map<std::size_t, uint32_t> cell_counts;
+
+  /* struct raster:
+     The points bucketed by graph row, as produced by prepare_data().
+     Preparing rewrites the points drawn in place as (row, column) and
+     sorts them by row, moving those not drawn (kept as they are) after
+     them. Row r (r < nrows, y = ytop - r*ystep) holds the columns of its
+     points in points[row_start[r]] .. points[row_start[r + 1] - 1], in no
+     order; restore_points() turns the points drawn back into (y, x).
+     Row axis is y = 0 (clamped to [-1, nrows] when not shown).
+     With several series the points' columns are stored as
+     column*nseries + series, so that series are sorted with the points
+     and are told apart when drawing cells; point_chars holds the char of
+     each series.
+     Column c (c < ncols) holds the x-values starting at xleft + c*xstep,
+     or, if elided, at col_x[c]: the populated columns are xcols (counted
+     in xsteps from xleft), placed at the columns vis, with gap columns
+     (col_gap) in between.
+     Once points are plot()ted the raster is dense instead: row r holds
+     the (series-coded) columns of its points as bits in
+     cells[r*row_words] .. cells[(r + 1)*row_words - 1].
+     If braille, each text row shows four rows (text row t the rows
+     4t .. 4t + 3) and each char two columns.
+  */
+  struct raster {
+    Value ytop, ybottom;                // Limits rounded to multiples of ystep
+    int nrows, axis;
+    Value xleft;
+    int ncols;
+    long long xcount;                   // Columns in [xleft, xmax]
+    int nseries;
+    std::string point_chars;
+    std::vector<std::size_t> row_start, row_next;
+    bool prepared;                      // Are the points rewritten?
+    std::vector<uint64_t> bar_up, bar_down; // Bar state bits of each column
+    std::vector<int> bar_from, bar_to, blank_to; // Bar rows (plan_bars())
+    bool elided;
+    std::vector<long long> xcols;
+    std::vector<wide> col_x;
+    std::vector<int> vis;
+    std::vector<bool> col_gap;
+    bool dense;
+    bool braille;
+    std::size_t row_words;
+    std::vector<uint64_t> cells;
+  } grid;
+
+  // Rendering buffers (reused across rows and graphs)
+  std::string row;
+  std::string blank_row, guide_row, axis_row, mark_row;
+  std::vector<std::pair<int, std::size_t>> mark_rows; // (row, mark) by row
+  std::vector<uint64_t> row_bits;
 };
 
+// The graphs of int data; the others are basic_asciigraph<int64_t> etc.
+typedef basic_asciigraph<int> asciigraph;
+typedef basic_asciigraph<int, BAR_GRAPH> bar_asciigraph;
+// The graphs of int64_t data, as drawn by the executable
+typedef basic_asciigraph<int64_t> asciigraph64;
+typedef basic_asciigraph<int64_t, BAR_GRAPH> bar_asciigraph64;
+
+// Instantiated in asciigraph.cpp
+extern template class basic_asciigraph<int, SCATTER_GRAPH>;
+extern template class basic_asciigraph<int, BAR_GRAPH>;
+extern template class basic_asciigraph<int64_t, SCATTER_GRAPH>;
+extern template class basic_asciigraph<int64_t, BAR_GRAPH>;
+extern template class basic_asciigraph<double, SCATTER_GRAPH>;
+extern template class basic_asciigraph<double, BAR_GRAPH>;
+
 /* Model asciigraph:
   |
   |
@@ -193,6 +759,18 @@ private:
   ------------------
 */
 
+/* get_bit() / set_bit():
+   Access bit i of a packed bitset.
+*/
+inline bool get_bit(const std::vector<uint64_t> &bits, const std::size_t i){
+  return (bits[i >> 6] >> (i & 63)) & 1;
+}
+inline void set_bit(std::vector<uint64_t> &bits, const std::size_t i,
+		    const bool val){
+  if(val) bits[i >> 6] |=  ((uint64_t)1 << (i & 63));
+  else    bits[i >> 6] &= ~((uint64_t)1 << (i & 63));
+}
+
 /* struct descending_y_order:
    A functor defining the sorting scheme of integer pairs (a, b):
    'a' descending as the primary sorting with 'b' ascending as the secondary.
@@ -207,7 +785,7 @@ struct descending_y_order {
     else{
       if(p1.first < p2.first) return false;
       else{
-	return p1.second <= p2.second;
+	return p1.second < p2.second;
       }
     }
   }
@@ -0,0 +1,249 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "asciigraph_c.h"
+#include "asciigraph.h"
+
+/* struct ag_graph:
+   A graph handle: the settings and points given through the API, and the
+   graph drawing them. Settings may change between renders, so the points
+   are kept here and copied into the graph (whose memory is reused) when
+   it is rendered with the current settings.
+*/
+struct ag_graph {
+  explicit ag_graph(const int _kind)
+    : kind(_kind), limits_set(false),
+      xmin(0), xmax(1), xstep(1), ymin(0), ymax(1), ystep(1),
+      X_AXIS_CHAR(X_AXIS_CHAR_DEFAULT), Y_AXIS_CHAR(Y_AXIS_CHAR_DEFAULT),
+      GUIDELINE_CHAR(GUIDELINE_CHAR_DEFAULT),
+      POINT_CHAR(POINT_CHAR_DEFAULT),
+      X_LABEL_DENSITY(X_LABEL_DENSITY_DEFAULT),
+      GUIDELINE_DENSITY(GUIDELINE_DENSITY_DEFAULT),
+      X_AXIS_LABEL(X_AXIS_LABEL_DEFAULT), Y_AXIS_LABEL(Y_AXIS_LABEL_DEFAULT),
+      WIDTH_PAD(WIDTH_PAD_DEFAULT), BAR_ZERO_POINT(BAR_ZERO_POINT_DEFAULT),
+      ELIDE_GAPS(ELIDE_GAPS_DEFAULT), GAP_CHAR(GAP_CHAR_DEFAULT),
+      BRAILLE(BRAILLE_DEFAULT) {
+    if(kind == AG_BAR) bar.reset(new bar_asciigraph(points, 0, 1, 1, 0, 1, 1));
+    else scatter.reset(new asciigraph(points, 0, 1, 1, 0, 1, 1));
+    // Graphs may be drawn from several threads at once, one per handle
+    if(bar) bar -> render_in_parallel(false);
+    else scatter -> render_in_parallel(false);
+  }
+
+  /* prepare():
+     Gives the graph the current settings and the points.
+  */
+  template <class Graph>
+  void prepare(Graph &ag){
+    ag.reset(xmin, xmax, xstep, ymin, ymax, ystep, false,
+	     X_AXIS_CHAR, Y_AXIS_CHAR, GUIDELINE_CHAR, POINT_CHAR,
+	     X_LABEL_DENSITY, GUIDELINE_DENSITY, X_AXIS_LABEL, Y_AXIS_LABEL,
+	     WIDTH_PAD, BAR_ZERO_POINT, ELIDE_GAPS, GAP_CHAR, BRAILLE);
+    ag.setPoints(points.data(), points.size());
+  }
+
+  int kind;
+  std::unique_ptr<asciigraph> scatter;     // The graph drawn, by kind
+  std::unique_ptr<bar_asciigraph> bar;
+  std::vector<asciigraph::point> points;   // ( x , y )
+  bool limits_set;
+  int xmin, xmax, xstep, ymin, ymax, ystep;
+  char X_AXIS_CHAR, Y_AXIS_CHAR, GUIDELINE_CHAR, POINT_CHAR;
+  int X_LABEL_DENSITY, GUIDELINE_DENSITY;
+  std::string X_AXIS_LABEL, Y_AXIS_LABEL;
+  int WIDTH_PAD;
+  bool BAR_ZERO_POINT;
+  bool ELIDE_GAPS;
+  char GAP_CHAR;
+  bool BRAILLE;
+};
+
+/* Runs f, turning the exceptions it throws into status codes */
+template <class F>
+static int guarded(F f){
+  try{
+    return f();
+  }catch(const std::bad_alloc &e){
+    return AG_ENOMEM;
+  }catch(const std::length_error &e){
+    return AG_ENOMEM;
+  }catch(const std::logic_error &e){
+    return AG_EINVAL;
+  }catch(...){
+    return AG_EINTERNAL;
+  }
+}
+
+// Is c a char that can be drawn?
+static bool drawable(const int c){
+  return c > 0 && c < 256;
+}
+
+extern "C" {
+
+int ag_create(ag_graph **g, int kind){
+  if(g == nullptr) return AG_EINVAL;
+  *g = nullptr;
+  if(kind != AG_SCATTER && kind != AG_BAR) return AG_EINVAL;
+  return guarded([&]{
+      *g = new ag_graph(kind);
+      return AG_OK;
+    });
+}
+
+void ag_destroy(ag_graph *g){
+  delete g;
+}
+
+int ag_set_limits(ag_graph *g, int xmin, int xmax, int xstep,
+		  int ymin, int ymax, int ystep){
+  if(g == nullptr) return AG_EINVAL;
+  if(!(xmin < xmax) || !(xstep > 0) || !(ymin < ymax) || !(ystep > 0)){
+    return AG_EINVAL;
+  }
+  g -> xmin = xmin;  g -> xmax = xmax;  g -> xstep = xstep;
+  g -> ymin = ymin;  g -> ymax = ymax;  g -> ystep = ystep;
+  g -> limits_set = true;
+  return AG_OK;
+}
+
+int ag_set_option(ag_graph *g, int option, int value){
+  if(g == nullptr) return AG_EINVAL;
+  switch(option){
+  case AG_X_AXIS_CHAR:
+  case AG_Y_AXIS_CHAR:
+  case AG_GUIDELINE_CHAR:
+  case AG_POINT_CHAR:
+  case AG_GAP_CHAR:
+    if(!drawable(value)) return AG_EINVAL;
+    break;
+  case AG_X_LABEL_DENSITY:
+  case AG_GUIDELINE_DENSITY:
+    if(value < 1) return AG_EINVAL;
+    break;
+  case AG_WIDTH_PAD:
+    if(value < 0) return AG_EINVAL;
+    break;
+  case AG_BAR_ZERO_POINT:
+  case AG_ELIDE_GAPS:
+  case AG_BRAILLE:
+    if(value != 0 && value != 1) return AG_EINVAL;
+    break;
+  default:
+    return AG_EINVAL;
+  }
+  switch(option){
+  case AG_X_AXIS_CHAR:       g -> X_AXIS_CHAR = (char)value;       break;
+  case AG_Y_AXIS_CHAR:       g -> Y_AXIS_CHAR = (char)value;       break;
+  case AG_GUIDELINE_CHAR:    g -> GUIDELINE_CHAR = (char)value;    break;
+  case AG_POINT_CHAR:        g -> POINT_CHAR = (char)value;        break;
+  case AG_GAP_CHAR:          g -> GAP_CHAR = (char)value;          break;
+  case AG_X_LABEL_DENSITY:   g -> X_LABEL_DENSITY = value;         break;
+  case AG_GUIDELINE_DENSITY: g -> GUIDELINE_DENSITY = value;       break;
+  case AG_WIDTH_PAD:         g -> WIDTH_PAD = value;               break;
+  case AG_BAR_ZERO_POINT:    g -> BAR_ZERO_POINT = value;          break;
+  case AG_ELIDE_GAPS:        g -> ELIDE_GAPS = value;              break;
+  case AG_BRAILLE:           g -> BRAILLE = value;                 break;
+  }
+  return AG_OK;
+}
+
+int ag_set_label(ag_graph *g, int label, const char *text){
+  if(g == nullptr || text == nullptr) return AG_EINVAL;
+  if(label != AG_X_AXIS_LABEL && label != AG_Y_AXIS_LABEL) return AG_EINVAL;
+  return guarded([&]{
+      (label == AG_X_AXIS_LABEL  ?  g -> X_AXIS_LABEL : g -> Y_AXIS_LABEL)
+	= text;
+      return AG_OK;
+    });
+}
+
+int ag_reserve(ag_graph *g, size_t n){
+  if(g == nullptr) return AG_EINVAL;
+  return guarded([&]{
+      g -> points.reserve(n);
+      if(g -> bar) g -> bar -> reserve(n);
+      else g -> scatter -> reserve(n);
+      return AG_OK;
+    });
+}
+
+int ag_add_points(ag_graph *g, const int *xs, const int *ys, size_t n){
+  if(g == nullptr || (ys == nullptr && n > 0)) return AG_EINVAL;
+  return guarded([&]{
+      std::vector<asciigraph::point> &points = g -> points;
+      const std::size_t first = points.size();
+      // Grow as push_back() would, so that memory is kept between graphs
+      if(first + n > points.capacity()){
+	points.reserve(std::max(first + n, 2*points.capacity()));
+      }
+      for(std::size_t i = 0; i < n; ++i){
+	const int x = xs  ?  xs[i] : (int)(first + i);
+	points.push_back(asciigraph::point(x, ys[i]));
+      }
+      return AG_OK;
+    });
+}
+
+void ag_clear(ag_graph *g){
+  if(g) g -> points.clear();
+}
+
+int ag_render(ag_graph *g, char *buf, size_t size, size_t *length){
+  if(g == nullptr || (buf == nullptr && size > 0)) return AG_EINVAL;
+  if(!g -> limits_set) return AG_ENOLIMITS;
+  return guarded([&]{
+      std::size_t total;
+      if(g -> bar){
+	g -> prepare(*g -> bar);
+	total = (*g -> bar)(buf, size);
+      }
+      else{
+	g -> prepare(*g -> scatter);
+	total = (*g -> scatter)(buf, size);
+      }
+      if(length) *length = total;
+      return (total > size)  ?  AG_ETRUNC : AG_OK;
+    });
+}
+
+int ag_render_fd(ag_graph *g, int fd){
+  if(g == nullptr || fd < 0) return AG_EINVAL;
+  if(!g -> limits_set) return AG_ENOLIMITS;
+  return guarded([&]{
+      bool written;
+      if(g -> bar){
+	g -> prepare(*g -> bar);
+	written = (*g -> bar)(fd);
+      }
+      else{
+	g -> prepare(*g -> scatter);
+	written = (*g -> scatter)(fd);
+      }
+      return written  ?  AG_OK : AG_EIO;
+    });
+}
+
+const char *ag_strerror(int status){
+  switch(status){
+  case AG_OK:        return "Success";
+  case AG_EINVAL:    return "Invalid argument";
+  case AG_ENOMEM:    return "Out of memory";
+  case AG_ENOLIMITS: return "Limits not set";
+  case AG_ETRUNC:    return "Graph truncated to the buffer";
+  case AG_EIO:       return "Graph could not be written";
+  case AG_EINTERNAL: return "Internal error";
+  default:           return "Unknown status";
+  }
+}
+
+}
@@ -0,0 +1,162 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+/* libasciigraph C API:
+   Draws int graphs (asciigraph and bar_asciigraph) from other languages
+   without running the asciigraph executable, through a graph handle:
+
+     ag_graph *g;
+     ag_create(&g, AG_SCATTER);
+     ag_set_limits(g, 0, 99, 1, 0, 20, 1);
+     ag_add_points(g, xs, ys, n);
+     ag_render(g, buf, sizeof(buf), &length);
+     ag_destroy(g);
+
+   Every function returning int returns AG_OK or one of the (negative)
+   ag_status codes; no C++ exception leaves the library. A handle keeps
+   the memory of its points and of the graph drawn between renders, so
+   once a handle has drawn a graph as large as the next, adding points
+   and rendering do not allocate.
+   A handle must not be used from several threads at once; separate
+   handles may be. Graphs are always rendered on the calling thread.
+*/
+
+#ifndef ASCIIGRAPH_C_H
+#define ASCIIGRAPH_C_H
+
+#include <stddef.h>
+
+#if defined(__GNUC__)
+#define AG_API __attribute__((visibility("default")))
+#else
+#define AG_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* enum ag_status:
+   The results of the functions of the API.
+*/
+enum ag_status {
+  AG_OK        =  0,
+  AG_EINVAL    = -1,   /* An argument, limit or setting is invalid */
+  AG_ENOMEM    = -2,   /* Out of memory */
+  AG_ENOLIMITS = -3,   /* Rendering before ag_set_limits() */
+  AG_ETRUNC    = -4,   /* The graph rendered did not fit into the buffer */
+  AG_EIO       = -5,   /* The graph could not be written out */
+  AG_EINTERNAL = -6    /* Any other failure */
+};
+
+/* enum ag_kind:
+   The kinds of graph a handle draws (see graph_kind).
+*/
+enum ag_kind {
+  AG_SCATTER = 0,      /* Points */
+  AG_BAR     = 1       /* A bar from the x-axis to each point */
+};
+
+/* enum ag_option:
+   The settings of ag_set_option(), as for the asciigraph constructor.
+   Chars are given as their (non-zero) code, flags as 0 or 1.
+*/
+enum ag_option {
+  AG_X_AXIS_CHAR,
+  AG_Y_AXIS_CHAR,
+  AG_GUIDELINE_CHAR,
+  AG_POINT_CHAR,
+  AG_X_LABEL_DENSITY,  /* At least 1 */
+  AG_GUIDELINE_DENSITY,/* At least 1 */
+  AG_WIDTH_PAD,        /* At least 0 */
+  AG_BAR_ZERO_POINT,
+  AG_ELIDE_GAPS,
+  AG_GAP_CHAR,
+  AG_BRAILLE
+};
+
+/* enum ag_label:
+   The labels of ag_set_label().
+*/
+enum ag_label {
+  AG_X_AXIS_LABEL,
+  AG_Y_AXIS_LABEL
+};
+
+typedef struct ag_graph ag_graph;
+
+/* ag_create():
+   Creates a graph handle of the given kind (ag_kind) with the default
+   settings, no points and no limits, storing it in *g.
+*/
+AG_API int ag_create(ag_graph **g, int kind);
+
+/* ag_destroy():
+   Frees the handle g (which may be NULL).
+*/
+AG_API void ag_destroy(ag_graph *g);
+
+/* ag_set_limits():
+   Sets the limits and steps of the graph, as for the asciigraph
+   constructor: AG_EINVAL unless min < max and step > 0 on both axes.
+*/
+AG_API int ag_set_limits(ag_graph *g, int xmin, int xmax, int xstep,
+			 int ymin, int ymax, int ystep);
+
+/* ag_set_option():
+   Sets one of the settings (ag_option) of the graph to value.
+*/
+AG_API int ag_set_option(ag_graph *g, int option, int value);
+
+/* ag_set_label():
+   Sets one of the axis labels (ag_label) of the graph to the
+   '\0'-terminated text.
+*/
+AG_API int ag_set_label(ag_graph *g, int label, const char *text);
+
+/* ag_reserve():
+   Makes room for n points in all, so that adding them does not allocate.
+*/
+AG_API int ag_reserve(ag_graph *g, size_t n);
+
+/* ag_add_points():
+   Adds the n points (xs[i], ys[i]) to the graph. If xs is NULL, the
+   points' x-values count on from the number of points already added
+   (as basic data is graphed against 0, 1, 2, ...).
+*/
+AG_API int ag_add_points(ag_graph *g, const int *xs, const int *ys,
+			 size_t n);
+
+/* ag_clear():
+   Removes the points of the graph, keeping the settings and memory.
+*/
+AG_API void ag_clear(ag_graph *g);
+
+/* ag_render():
+   Draws the points added so far into buf, as the asciigraph executable
+   would. Like snprintf, *length (if not NULL) is set to the size of the
+   whole graph, of which only the first size bytes are stored (no '\0' is
+   added), and AG_ETRUNC is returned if it did not fit, so a NULL buf of
+   size 0 finds the size needed. The points are kept, so more can be
+   added and the graph rendered again.
+*/
+AG_API int ag_render(ag_graph *g, char *buf, size_t size, size_t *length);
+
+/* ag_render_fd():
+   As ag_render(), writing the graph to the file descriptor fd.
+*/
+AG_API int ag_render_fd(ag_graph *g, int fd);
+
+/* ag_strerror():
+   @return                  A description of the given status code
+*/
+AG_API const char *ag_strerror(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,323 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+/* bench:
+   Benchmarks of asciigraph's stages on synthetic basic, scatter and bar
+   inputs, from 1e3 points up to max_points (default 1e7) in powers of 10:
+     parse     Reading the input with streamGraph (its parse_s), the
+               graph drawn to a counting sink
+     prepare   Constructing an asciigraph and preparing its data
+     render    Drawing the prepared graph
+     graph     A whole `./asciigraph -f` run (if ./asciigraph exists)
+   prepare, render and graph are run with several ystep/WIDTH_PAD settings.
+   Graphs of basic and bar data are as wide as their number of points, so
+   those stages stop at BENCH_MAX_BASIC and BENCH_MAX_BAR points.
+
+   Each case runs in its own process so that its peak RSS can be found.
+   Each result is printed as one JSON object per line on stdout:
+     {"bench": stage, "input": kind, "points", "ystep", "width_pad",
+      "bytes", "seconds", "ns_per_point", "bytes_per_s", "peak_rss_kb",
+      "isa"}
+   where bytes is the input read (parse) or the graph output (render,
+   graph; 0 for prepare), and seconds is the best of a few repetitions.
+
+   usage: bench [max_points]
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "asciigraph.h"
+#include "graph.h"
+#include "linereader.h"
+#include "stats.h"
+
+// Largest basic and bar inputs graphed
+#define BENCH_MAX_BASIC 1000000
+#define BENCH_MAX_BAR   100000
+
+enum input_kind { BASIC, SCATTER, BAR };
+static const char *const kind_names[] = {"basic", "scatter", "bar"};
+
+// The ystep/WIDTH_PAD settings graphs are benchmarked with
+static const std::pair<int, int> settings[] = {{1, 1}, {1, 0}, {1, 3},
+					       {10, 1}};
+
+/* Class graph_bench:
+   Runs the stages of asciigraph::operator() separately.
+*/
+class graph_bench {
+public:
+  template <typename Graph>
+  static void prepare(Graph &ag){
+    ag.prepare_data();
+  }
+  template <typename Graph>
+  static void render(Graph &ag, std::ostream &out){
+    ag.render(out);
+  }
+};
+
+// A stream buffer which only counts the bytes written to it
+class count_buf : public std::streambuf {
+public:
+  std::size_t bytes = 0;
+protected:
+  int overflow(int c) override { ++bytes; return c; }
+  std::streamsize xsputn(const char *, std::streamsize n) override {
+    bytes += n;
+    return n;
+  }
+};
+
+// The i'th point of the synthetic data of the given kind
+static std::pair<int, int> make_point(const input_kind kind,
+				      const std::size_t i, std::mt19937 &rng){
+  if(kind == SCATTER){
+    int x = rng()%1000;
+    return std::pair<int, int>(x, (int)(rng()%1000) - 500);
+  }
+  return std::pair<int, int>((int)i, (int)(rng()%100) - 50);
+}
+
+// The limits of the synthetic data: xmin, xmax, ymin, ymax
+static void data_limits(const input_kind kind, const std::size_t n,
+			int lim[4]){
+  lim[0] = 0;
+  lim[1] = (kind == SCATTER)  ?  999 : (int)n - 1;
+  lim[2] = (kind == SCATTER)  ?  -500 : -50;
+  lim[3] = (kind == SCATTER)  ?  499 : 49;
+}
+
+// Writes n points of the given kind to path, returning the number of bytes
+static std::size_t write_input(const std::string &path, const input_kind kind,
+			       const std::size_t n, const std::string &header){
+  std::mt19937 rng(42);
+  FILE *out = std::fopen(path.c_str(), "w");
+  if(out == nullptr){
+    std::cerr << "unable to write " << path << std::endl;
+    std::exit(1);
+  }
+  std::size_t bytes = std::fprintf(out, "%s%s", header.c_str(),
+				   (kind == BAR)  ?  "#bar\n" : "");
+  for(std::size_t i = 0; i < n; ++i){
+    std::pair<int, int> p = make_point(kind, i, rng);
+    if(kind == BASIC) bytes += std::fprintf(out, "%d\n", p.second);
+    else if(kind == SCATTER){
+      bytes += std::fprintf(out, "%d,%d\n", p.first, p.second);
+    }
+    else bytes += std::fprintf(out, "%d, label %zu\n", p.second, i);
+  }
+  std::fclose(out);
+  return bytes;
+}
+
+// Graphs the data of path with streamGraph, to a counting sink, returning
+// the seconds spent reading the data (parse_s)
+static double parse_input(const std::string &path){
+  line_reader in(path);
+  count_buf counter;
+  std::ostream out(&counter);
+  graph_buffers buf;
+  buf.out = &out;
+  run_stats stats;
+  streamGraph(in, buf, false, &stats);
+  return stats.parse_s;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point t0){
+  std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+  return dt.count();
+}
+
+// Repetitions timed for n points
+static int repetitions(const std::size_t n){
+  return (n <= 100000)  ?  5 : ((n <= 1000000)  ?  3 : 1);
+}
+
+/* run_case():
+   Runs a stage in a child process, which returns the best time and the
+   bytes handled through a pipe, and prints the result.
+*/
+static void run_case(const char *stage, const input_kind kind,
+		     const std::size_t n, const std::pair<int, int> setting,
+		     const std::function<void(double &, std::size_t &)> &run){
+  int fds[2];
+  if(pipe(fds) != 0) return;
+  pid_t pid = fork();
+  if(pid == 0){
+    close(fds[0]);
+    double seconds = 0;
+    std::size_t bytes = 0;
+    run(seconds, bytes);
+    char msg[64];
+    int len = std::snprintf(msg, sizeof(msg), "%.9f %zu", seconds, bytes);
+    if(write(fds[1], msg, len) != len) _exit(1);
+    _exit(0);
+  }
+  close(fds[1]);
+  char msg[64] = {0};
+  ssize_t got = read(fds[0], msg, sizeof(msg) - 1);
+  close(fds[0]);
+  int status;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+  double seconds;
+  std::size_t bytes;
+  if(got <= 0 || std::sscanf(msg, "%lf %zu", &seconds, &bytes) != 2){
+    std::cerr << stage << " " << kind_names[kind] << " " << n
+	      << ": failed" << std::endl;
+    return;
+  }
+  std::printf("{\"bench\":\"%s\",\"input\":\"%s\",\"points\":%zu,"
+	      "\"ystep\":%d,\"width_pad\":%d,\"bytes\":%zu,"
+	      "\"seconds\":%.6f,\"ns_per_point\":%.3f,\"bytes_per_s\":%.0f,"
+	      "\"peak_rss_kb\":%ld,\"isa\":\"%s\"}\n",
+	      stage, kind_names[kind], n, setting.first, setting.second, bytes,
+	      seconds, 1e9*seconds/n, bytes/seconds, usage.ru_maxrss,
+	      scan_isa());
+  std::fflush(stdout);
+}
+
+// Builds the graph (asciigraph or bar_asciigraph) of n synthetic points
+// with the given setting
+template <typename Graph>
+static Graph make_graph(const input_kind kind, const std::size_t n,
+			const std::pair<int, int> setting){
+  std::mt19937 rng(42);
+  std::vector<std::pair<int, int>> pts;
+  pts.reserve(n);
+  for(std::size_t i = 0; i < n; ++i) pts.push_back(make_point(kind, i, rng));
+  int lim[4];
+  data_limits(kind, n, lim);
+  return Graph(std::move(pts), lim[0], lim[1], 1, lim[2], lim[3],
+	       setting.first,
+	       false, X_AXIS_CHAR_DEFAULT, Y_AXIS_CHAR_DEFAULT,
+	       GUIDELINE_CHAR_DEFAULT, POINT_CHAR_DEFAULT,
+	       (kind == BAR)  ?  1 : X_LABEL_DENSITY_DEFAULT,
+	       GUIDELINE_DENSITY_DEFAULT, X_AXIS_LABEL_DEFAULT,
+	       Y_AXIS_LABEL_DEFAULT, setting.second);
+}
+
+/* bench_graph():
+   Benchmarks preparing and rendering the graph of n synthetic points
+   with the given setting, as a Graph.
+*/
+template <typename Graph>
+static void bench_graph(const input_kind kind, const std::size_t n,
+			const std::pair<int, int> setting, const int reps){
+  /* prepare */
+  run_case("prepare", kind, n, setting,
+	   [&](double &seconds, std::size_t &bytes){
+	     seconds = 1e30;
+	     for(int r = 0; r < reps; ++r){
+	       Graph ag = make_graph<Graph>(kind, n, setting);
+	       auto t0 = std::chrono::steady_clock::now();
+	       graph_bench::prepare(ag);
+	       seconds = std::min(seconds, seconds_since(t0));
+	     }
+	     bytes = 0;
+	   });
+
+  /* render */
+  run_case("render", kind, n, setting,
+	   [&](double &seconds, std::size_t &bytes){
+	     Graph ag = make_graph<Graph>(kind, n, setting);
+	     graph_bench::prepare(ag);
+	     seconds = 1e30;
+	     for(int r = 0; r < reps; ++r){
+	       count_buf counter;
+	       std::ostream out(&counter);
+	       auto t0 = std::chrono::steady_clock::now();
+	       graph_bench::render(ag, out);
+	       seconds = std::min(seconds, seconds_since(t0));
+	       bytes = counter.bytes;
+	     }
+	   });
+}
+
+int main(int argc, char *argv[]){
+  std::size_t max_n = (argc > 1) ? std::strtoul(argv[1], nullptr, 10)
+                                 : 10000000;
+  char dir[] = "/tmp/asciigraph_bench_XXXXXX";
+  if(mkdtemp(dir) == nullptr){
+    std::cerr << "unable to create temporary directory" << std::endl;
+    return 1;
+  }
+  const std::string input = std::string(dir) + "/input";
+  const std::string output = std::string(dir) + "/output";
+  const bool have_binary = access("./asciigraph", X_OK) == 0;
+
+  for(int k = BASIC; k <= BAR; ++k){
+    const input_kind kind = (input_kind)k;
+    const std::size_t max_graph = (kind == BASIC)  ?  BENCH_MAX_BASIC :
+                                  (kind == BAR)    ?  BENCH_MAX_BAR : max_n;
+    for(std::size_t n = 1000; n <= max_n; n *= 10){
+      const int reps = repetitions(n);
+
+      /* parse: the graph drawn is kept low, as it is not timed */
+      const std::size_t input_bytes = write_input(input, kind, n,
+						  "#hmax 10\n");
+      run_case("parse", kind, n, settings[0],
+	       [&](double &seconds, std::size_t &bytes){
+		 parse_input(input); // Warm up
+		 seconds = 1e30;
+		 for(int r = 0; r < reps; ++r){
+		   seconds = std::min(seconds, parse_input(input));
+		 }
+		 bytes = input_bytes;
+	       });
+      if(n > max_graph) continue;
+
+      for(const std::pair<int, int> &setting : settings){
+	if(kind == BAR) bench_graph<bar_asciigraph>(kind, n, setting, reps);
+	else bench_graph<asciigraph>(kind, n, setting, reps);
+
+	/* graph: time the whole program on a file with the setting */
+	if(!have_binary) continue;
+	std::string header = "#ystep " + std::to_string(setting.first) +
+	  "\n#WIDTH_PAD " + std::to_string(setting.second) + "\n";
+	write_input(input, kind, n, header);
+	run_case("graph", kind, n, setting,
+		 [&](double &seconds, std::size_t &bytes){
+		   seconds = 1e30;
+		   for(int r = 0; r < reps; ++r){
+		     auto t0 = std::chrono::steady_clock::now();
+		     pid_t pid = fork();
+		     if(pid == 0){
+		       int fd = open(output.c_str(),
+				     O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		       dup2(fd, 1);
+		       execl("./asciigraph", "asciigraph", "-f", input.c_str(),
+			     (char *)nullptr);
+		       _exit(127);
+		     }
+		     int status;
+		     waitpid(pid, &status, 0);
+		     seconds = std::min(seconds, seconds_since(t0));
+		   }
+		   struct stat st;
+		   bytes = (stat(output.c_str(), &st) == 0)  ?  st.st_size : 0;
+		 });
+      }
+    }
+  }
+  unlink(input.c_str());
+  unlink(output.c_str());
+  rmdir(dir);
+  return 0;
+}
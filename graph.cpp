@@ -5,42 +5,222 @@
 /**************************************************/
 
 #include <iostream>
-#include <fstream>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <utility>
+#include <exception>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <system_error>
+#include <cerrno>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
 #include "asciigraph.h"
+#include "graph.h"
+#include "xbin.h"
+#include "histogram.h"
+#include "quantile.h"
+#include "options.h"
+#include "linereader.h"
+#include "threadpool.h"
+#include "live.h"
+#include "serve.h"
+#include "stats.h"
+
+// Inputs larger than this (in bytes) are parsed in parallel if possible
+#define PARALLEL_PARSE_MIN (4 << 20)
+// Size (in bytes) of the smallest part of the data parsed in parallel
+#define PARALLEL_PARSE_CHUNK (1 << 20)
 
 #define DEBUG if(debug)
 
-void fileGraph(const std::string &path, const bool debug);
-void streamGraph(std::istream &in, const bool debug);
+/* struct data_part:
+   The points and limits read from (a part of) the standard data, which
+   are either kept as they are or, when xstep > 1, grouped into bins.
+*/
+struct data_part {
+  data_part(const int64_t xstep, const aggregator xagg)
+    : binner(xstep, xagg), nseries(1), sketching(false), npts(0), lines(0),
+      comments(0), ended(false), next(false) {}
+
+  std::vector<asciigraph64::point> pts; // Used if xstep == 1 or series
+  xbinner binner;                       // Used if xstep > 1 (no series)
+  int nseries;                          // Scatter data: y-values per line
+  std::vector<uint8_t> series;          // Of each point, with nseries > 1
+  bool sketching;                       // Basic data: quantiles wanted?
+  quantile_sketch sketch;               // ...of the y-values, if so
+  int64_t xmin, xmax, ymin, ymax;       // Limits of the points read
+  long long npts;                       // Points read
+  int lines;                            // Lines read, including comments
+  int comments;                         // Comment lines skipped
+  bool ended;                           // Ended by a blank line/delimiter?
+  bool next;                            // Ended by a delimiter?
+  std::exception_ptr error;             // Parallel parsing: error found
+};
+
+bool drawGraph(line_reader &in, std::string_view line, graph_buffers &buf,
+	       const bool debug, run_stats *stats);
+template <typename Graph>
+Graph &batchGraph(graph_buffers &buf, std::unique_ptr<Graph> &ag,
+		  const graph_options &opt, const int nseries,
+		  const bool debug);
+bool rasterGraph(line_reader &in, std::string_view line, std::size_t pos,
+		 const int nseries, graph_options &opt, graph_buffers &buf,
+		 const bool debug, run_stats *stats);
+bool histogramData(line_reader &in, std::string_view line, std::size_t pos,
+		   graph_options &opt, graph_buffers &buf, const bool debug,
+		   run_stats *stats);
+void readData(line_reader &in, std::string_view line, std::size_t pos,
+	      const bool scatter, data_part &data, const bool debug);
+void parseData(line_reader &in, std::string_view line, std::size_t pos,
+	       const bool scatter, const int64_t first_x, data_part &data,
+	       const bool debug);
+static std::string graphFileName(const std::string &path,
+				 const std::string &outdir);
+static bool writeGraphFile(const std::string &name, const std::string &output,
+			   std::mutex &out_lock);
+static bool writeAll(const int fd, const std::string &buf);
+static void markQuantiles(asciigraph64 &ag, const graph_options &opt,
+			  const quantile_sketch &sketch);
+static const char *data_end(const char *p, const char *end);
+static inline void addData(data_part &data, const int64_t x,
+			   const int64_t y, const bool binning);
+template <typename F>
+static void parseSeries(std::string_view line, std::size_t pos,
+			const int nseries, F f);
+
+// Built without main() (GRAPH_NO_MAIN) when linked into bench
+#ifndef GRAPH_NO_MAIN
+/* globPaths():
+   Adds the files matching pattern (a glob, which the shell may have left
+   unexpanded, e.g. when it matches too many files to pass) to paths, or
+   pattern itself if it is not a glob or matches nothing.
+*/
+static void globPaths(const char *pattern, std::vector<std::string> &paths){
+  glob_t matches;
+  if(std::strpbrk(pattern, "*?[") &&
+     glob(pattern, 0, nullptr, &matches) == 0){
+    paths.insert(paths.end(), matches.gl_pathv,
+		 matches.gl_pathv + matches.gl_pathc);
+    globfree(&matches);
+    return;
+  }
+  paths.push_back(pattern);
+}
 
 int main(int argc, char *argv[]){
   bool debug = false;
+  int status = 0;
+  std::ios::sync_with_stdio(false);
+
+  // --stats applies to the whole run, wherever it is given
+  run_stats run;
+  run_stats *stats = nullptr;
+  for(int i = 1; i < argc; ++i){
+    if(std::strcmp(argv[i], "--stats") == 0) stats = &run;
+  }
+  // -o applies to every file graphed, wherever it is given
+  std::string outdir;
+  for(int i = 1; i + 1 < argc; ++i){
+    if(std::strcmp(argv[i], "-o") == 0) outdir = argv[i + 1];
+  }
+  // Count the bytes of graph output
+  std::streambuf *cout_buf = std::cout.rdbuf();
+  counting_buf counter(cout_buf);
+  if(stats) std::cout.rdbuf(&counter);
 
   for(int i = 1; i < argc; ++i){
     if(argv[i][0] == '-'){
       switch(argv[i][1]){
+      case '-':
+	if(std::strcmp(argv[i], "--stats") == 0) break; // Handled above
+	if(std::strcmp(argv[i], "--serve") == 0 ||
+	   std::strcmp(argv[i], "--send") == 0){
+	  if(argc <= i + 1){
+	    std::cout << "No socket path supplied. Exiting..." << std::endl;
+	    return 1;
+	  }
+	  try{
+	    if(std::strcmp(argv[i], "--serve") == 0){
+	      unsigned workers = 0;
+	      if(argc > i + 2 && argv[i + 2][0] >= '0' && argv[i + 2][0] <= '9'){
+		workers = std::stoul(argv[i + 2]);
+	      }
+	      DEBUG std::cerr << "Serving graphs..." << std::endl;
+	      serveGraphs(argv[i + 1], workers, debug);
+	    }
+	    else{
+	      DEBUG std::cerr << "Sending stdin to be graphed..." << std::endl;
+	      sendGraph(argv[i + 1], std::cin, std::cout);
+	    }
+	  }catch(const std::system_error &e){
+	    std::cout << "Unable to use socket, with error \"" << e.what()
+		      << "\". Exiting..." << std::endl;
+	    return 1;
+	  }catch(const invalid_data &e){
+	    std::cout << "The server's reply is invalid, with error \""
+		      << e.what() << "\". Exiting..." << std::endl;
+	    return 1;
+	  }
+	  break;
+	}
+	std::cout << "Invalid option supplied. For help, try \"-h\". Exiting..."
+		  << std::endl;
+	return 1;
+
       case 'h':
 	std::cout << "asciigraph is a utility to produce simple graphs"
 	  " of arbitrary data in ascii. The format for running asciigraph"
 	  " is as follows:\n\n"
-	  "\tasciigraph [-d] <-h | -s | -f </absolute/path/to/file> >\n\n"
+	  "\tasciigraph [-d] [--stats]"
+	  " <-h | -s | -l [N] | -f <file...> [-o <dir>] |"
+	  " --serve <socket> [N] | --send <socket> >\n\n"
 	  "The meaning of the switches are...\n\n"
 	  "-d\tEnable debug output logging to stderr."
 	  " *NOTE* This will break graphs unless stderr is redirected"
 	  " elsewhere from the asciigraph's output.\n"
 	  "-h\tDisplay this help message.\n"
 	  "-s\tPull graph data directly from stdin.\n"
-	  "-f\tPull graph data from the specified file.\n\n"
+	  "-l\tGraph the last N (default " << LIVE_WINDOW_DEFAULT << ")"
+	  " points from stdin live, as they arrive.\n"
+	  "-f\tPull graph data from the specified files (or globs), graphing"
+	  " several at once.\n"
+	  "-o\tWrite the graphs of each file given to -f to a file of its own"
+	  " in the specified directory.\n"
+	  "--stats\tPrint the time taken by each stage of graphing and counts"
+	  " of the data read, as a line of JSON on stderr at exit.\n"
+	  "--serve\tServe graphs of requests on the Unix domain socket given,"
+	  " with N (default: one per hardware thread) workers.\n"
+	  "--send\tGraph stdin with the server on the socket given.\n\n"
 	  "Please read the readme for more information.\n\n" << std::endl;
 	break;
 	
       case 's':
 	DEBUG std::cerr << "Pulling data from stdin..." << std::endl;
 	try{
-	  streamGraph(std::cin, debug);
+	  line_reader in(std::cin);
+	  streamGraph(in, debug, stats);
+	}catch(const invalid_data &e){
+	  std::cout << "The data provided is invalid, with error \""
+		    << e.what() << "\". Please read the readme for data"
+	    " format requirements. Exiting..." << std::endl;
+	}
+	break;
+
+      case 'l':
+	DEBUG std::cerr << "Graphing stdin live..." << std::endl;
+	try{
+	  std::size_t window = LIVE_WINDOW_DEFAULT;
+	  if(argc > i + 1 && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9'){
+	    window = std::stoul(argv[i + 1]);
+	  }
+	  liveGraph(0, window, debug);
 	}catch(const invalid_data &e){
 	  std::cout << "The data provided is invalid, with error \""
 		    << e.what() << "\". Please read the readme for data"
@@ -51,8 +231,18 @@ int main(int argc, char *argv[]){
       case 'f':
 	DEBUG std::cerr << "Pulling data from file..." << std::endl;
 	if(argc > i + 1){
+	  // Every path (or glob) up to the next switch is graphed
+	  std::vector<std::string> paths;
+	  globPaths(argv[i + 1], paths);
+	  for(int j = i + 2; j < argc && argv[j][0] != '-'; ++j){
+	    globPaths(argv[j], paths);
+	  }
+	  if(paths.size() > 1 || !outdir.empty()){
+	    if(!filesGraph(paths, outdir, debug, stats)) status = 1;
+	    break;
+	  }
 	  try{
-	    fileGraph(argv[i + 1], debug);
+	    fileGraph(paths[0], debug, stats);
 	  }catch (const file_not_found &e){
 	    std::cout << "Unable to open file, with error \"" << e.what()
 		      << "\". Please check the given path, that the file"
@@ -67,6 +257,13 @@ int main(int argc, char *argv[]){
 	}
 	break;
 
+      case 'o':
+	if(argc <= i + 1){ // Otherwise handled above
+	  std::cout << "No output directory supplied. Exiting..." << std::endl;
+	  return 1;
+	}
+	break;
+
       case 'd':
 	debug = true;
 	DEBUG std::cerr << "DEBUG turned on" << std::endl;
@@ -79,188 +276,253 @@ int main(int argc, char *argv[]){
       }// end switch
     }// end if
   }// end for
+
+  if(stats){
+    std::cout.flush();
+    std::cout.rdbuf(cout_buf);
+    run.bytes += counter.count();
+    run.report(std::cerr);
+  }
+  return status;
 }
+#endif
 
-/* fileGraph():
-   Graphs the data stored in the file path specified. 
-   
-   @params
-   const std::string &path     The path of the file containing data to graph
-   const bool debug            Print debug info?
+void fileGraph(const std::string &path, const bool debug, run_stats *stats){
+  line_reader file(path); // Memory maps the file if possible
+  try{
+    streamGraph(file, debug, stats);
+  }catch(const invalid_data &e){
+    std::cout << "The data provided is invalid, with error \""
+	      << e.what() << "\". Please read the readme"
+      " for data format requirements. Exiting..." << std::endl;
+  }
+}
 
-   @return
-   void
+bool fileGraph(const std::string &path, graph_buffers &buf,
+	       const bool debug, run_stats *stats, std::string &error){
+  try{
+    line_reader file(path);
+    streamGraph(file, buf, debug, stats);
+    return true;
+  }catch(const file_not_found &e){
+    error = std::string("Unable to open file, with error \"") + e.what() +
+      "\". Please check the given path, that the file exists, and its"
+      " permissions.";
+  }catch(const invalid_data &e){
+    error = std::string("The data provided is invalid, with error \"") +
+      e.what() + "\". Please read the readme for data format requirements.";
+  }
+  return false;
+}
 
-   @throws
-   file_not_found              File unable to be opened
+bool filesGraph(const std::vector<std::string> &paths,
+		const std::string &outdir, const bool debug, run_stats *stats){
+  std::cout.flush(); // Anything printed before comes first
+  // Output files are named after the input file alone: refuse to have
+  // one overwrite another
+  std::vector<std::string> names;
+  if(!outdir.empty()){
+    std::map<std::string, std::size_t> named;
+    for(std::size_t i = 0; i < paths.size(); ++i){
+      names.push_back(graphFileName(paths[i], outdir));
+      auto it = named.insert(std::make_pair(names[i], i));
+      if(it.second) continue;
+      std::cerr << "The graphs of \"" << paths[it.first -> second]
+		<< "\" and \"" << paths[i] << "\" would both be written to \""
+		<< names[i] << "\". Please graph files of the same name"
+	" to different directories. Exiting..." << std::endl;
+      return false;
+    }
+  }
+  thread_pool &pool = shared_pool();
+  const std::size_t nthreads = std::min<std::size_t>(pool.size(),
+						     paths.size());
+  std::atomic<std::size_t> next(0);
+  /* Stdout: the output of a file is kept until that of the files before
+     it has been written, by whichever thread finishes the last of them */
+  std::vector<std::string> outputs(outdir.empty()  ?  paths.size() : 0);
+  std::vector<bool> finished(outputs.size(), false);
+  std::size_t written = 0;
+  std::mutex out_lock;
+  std::atomic<bool> failed(false);
+  std::vector<run_stats> thread_stats(nthreads);
+  std::vector<std::exception_ptr> errors(nthreads);
+  pool.run(nthreads, [&](std::size_t k){
+      try{
+	graph_buffers buf;
+	std::string output;
+	string_buf sink;
+	sink.attach(&output);
+	std::ostream out(&sink);
+	buf.out = &out;
+	run_stats *st = stats  ?  &thread_stats[k] : nullptr;
+	std::string error;
+	for(std::size_t i = next++; i < paths.size(); i = next++){
+	  DEBUG std::cerr << "graphing " << paths[i] << std::endl;
+	  output.clear();
+	  const bool graphed = fileGraph(paths[i], buf, debug, st, error);
+	  out.flush();
+	  if(st) st -> bytes += output.size();
+	  if(!graphed){
+	    failed = true;
+	    std::lock_guard<std::mutex> guard(out_lock);
+	    writeAll(STDERR_FILENO, paths[i] + ": " + error + '\n');
+	  }
+	  if(!outdir.empty()){
+	    if(!graphed || !writeGraphFile(names[i], output, out_lock)){
+	      failed = true;
+	    }
+	    continue;
+	  }
+	  std::lock_guard<std::mutex> guard(out_lock);
+	  if(i == written){
+	    writeAll(STDOUT_FILENO, output);
+	    ++written;
+	  }
+	  else{
+	    outputs[i].swap(output);
+	    finished[i] = true;
+	  }
+	  for(; written < paths.size() && finished[written]; ++written){
+	    writeAll(STDOUT_FILENO, outputs[written]);
+	    std::string().swap(outputs[written]); // Free it
+	  }
+	}
+      }catch(...){
+	errors[k] = std::current_exception();
+      }
+    });
+  for(std::size_t k = 0; k < nthreads; ++k){
+    if(errors[k]) std::rethrow_exception(errors[k]);
+    if(stats) *stats += thread_stats[k];
+  }
+  return !failed;
+}
+
+// The file in outdir the graphs of the file path are written to (see
+// filesGraph())
+static std::string graphFileName(const std::string &path,
+				 const std::string &outdir){
+  const std::size_t slash = path.rfind('/');
+  return outdir + '/' +
+    path.substr((slash == std::string::npos)  ?  0 : slash + 1) + ".graph";
+}
+
+/* writeGraphFile():
+   Writes the graphs of a file to the file name, or why they could not be
+   to stderr.
+
+   @return
+   bool                        Were the graphs written?
 */
-void fileGraph(const std::string &path, const bool debug){
-  std::ifstream file(path);
-  if(file.is_open()){
-    try{
-      streamGraph(file, debug);
-    }catch(const invalid_data &e){
-      std::cout << "The data provided is invalid, with error \""
-		<< e.what() << "\". Please read the readme"
-	" for data format requirements. Exiting..." << std::endl;
+static bool writeGraphFile(const std::string &name, const std::string &output,
+			   std::mutex &out_lock){
+  const int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		      0644);
+  if(fd >= 0 && writeAll(fd, output) && close(fd) == 0) return true;
+  const std::string message = "Unable to write file \"" + name +
+    "\", with error \"" + std::generic_category().message(errno) +
+    "\".\n";
+  if(fd >= 0) close(fd);
+  std::lock_guard<std::mutex> guard(out_lock);
+  writeAll(STDERR_FILENO, message);
+  return false;
+}
+
+// Writes all of buf to the file descriptor fd
+static bool writeAll(const int fd, const std::string &buf){
+  for(std::size_t done = 0; done < buf.size(); ){
+    const ssize_t put = write(fd, buf.data() + done, buf.size() - done);
+    if(put < 0){
+      if(errno == EINTR) continue;
+      return false;
     }
-    file.close();
+    done += put;
   }
-  else{
-    throw file_not_found("File not found");
+  return true;
+}
+
+void streamGraph(line_reader &in, const bool debug, run_stats *stats){
+  graph_buffers buf;
+  streamGraph(in, buf, debug, stats);
+}
+
+void streamGraph(line_reader &in, graph_buffers &buf, const bool debug,
+		 run_stats *stats){
+  std::string_view line;
+  bool file_continues = in.getline(line);
+  while(file_continues){
+    if(!drawGraph(in, line, buf, debug, stats)){
+      // The data ended before any delimiter: skip to the next graph
+      while((file_continues = in.getline(line)) && !is_delimiter(line)){}
+      if(!file_continues) break;
+    }
+    DEBUG std::cerr << "next graph..." << std::endl;
+    file_continues = in.getline(line);
   }
 }
 
-/* streamGraph():
-   Graphs data obtained from the given istream.
+/* drawGraph():
+   Graphs the data starting at the given line (with the graph's options)
+   up to the end of the graph: a blank line, a delimiter, or the end of
+   the input.
    
    @params
-   std::istream &in       The stream from which to read data to graph
+   line_reader &in        The input from which to read data to graph
+   std::string_view line  The first line of the graph
+   graph_buffers &buf     The buffers to graph with
    const bool debug       Print debug info?
+   run_stats *stats       The stats to collect, if any
 
    @return
-   void
+   bool                   Did the graph end with a delimiter?
 
    @throws
    invalid_data           Data invalid format or invalid limits
 */
-void streamGraph(std::istream &in, const bool debug){
-  int xmin  = -1, xmax  = -1;
-  int ymin  = 0,  ymax  = 0;
-  int xstep = 1,  ystep = 1;
-  int hmax  = 0;
-  bool xmin_set = false,  xmax_set  = false,
-       ymin_set = false,  ymax_set  = false,
-       hmax_set = false,  bar_graph = false,
-              BAR_ZERO_POINT    = BAR_ZERO_POINT_DEFAULT;
-  char        X_AXIS_CHAR       = X_AXIS_CHAR_DEFAULT,
-              Y_AXIS_CHAR       = Y_AXIS_CHAR_DEFAULT,
-              GUIDELINE_CHAR    = GUIDELINE_CHAR_DEFAULT,
-              POINT_CHAR        = POINT_CHAR_DEFAULT;
-  int         X_LABEL_DENSITY   = X_LABEL_DENSITY_DEFAULT,
-              GUIDELINE_DENSITY = GUIDELINE_DENSITY_DEFAULT,
-              WIDTH_PAD         = WIDTH_PAD_DEFAULT;
-  std::string X_AXIS_LABEL      = X_AXIS_LABEL_DEFAULT,
-              Y_AXIS_LABEL      = Y_AXIS_LABEL_DEFAULT;
-
-
-
-  std::vector<std::pair<int, int>> pts;
-  
-  std::string line;
-  bool file_continues = getline(in, line);
+bool drawGraph(line_reader &in, std::string_view line, graph_buffers &buf,
+	       const bool debug, run_stats *stats){
+  graph_options opt;
+  std::vector<asciigraph64::point> &pts = buf.pts;
+  pts.clear();
+  buf.series.clear();
+  double start = stats  ?  stats_clock() : 0;
+  bool file_continues = true;
 
   /* Handle graph options if any */
-  try{
-    while(line != ""      &&
-	  file_continues  &&
-	  (line.c_str()[0] == '#' || line.c_str()[0] == ';')){
-      if(line.c_str()[0] == ';'){
-	DEBUG std::cerr << "skipping comment..." << std::endl;
-      }
-      else if(line.compare(1, 5, "ystep") == 0){
-	ystep = std::stoi(line.substr(7));
-	if(ystep <= 0) ystep = 1;
-	DEBUG std::cerr << "Set ystep to " << ystep << std::endl;
-      }
-      else if(line.compare(1, 4, "ymin") == 0){
-	ymin = std::stoi(line.substr(6));
-	ymin_set = true;
-	DEBUG std::cerr << "Set ymin to " << ymin << std::endl;
-      }
-      else if(line.compare(1, 4, "ymax") == 0){
-	ymax = std::stoi(line.substr(6));
-	ymax_set = true;
-	DEBUG std::cerr << "Set ymax to " << ymax << std::endl;
-      }
-      else if(line.compare(1, 4, "xmin") == 0){
-	xmin = std::stoi(line.substr(6));
-	xmin_set = true;
-	DEBUG std::cerr << "Set xmin to " << xmin << std::endl;
-      }
-      else if(line.compare(1, 4, "xmax") == 0){
-	xmax = std::stoi(line.substr(6));
-	xmax_set = true;
-	DEBUG std::cerr << "Set xmax to " << xmax << std::endl;
-      }
-      else if(line.compare(1, 4, "hmax") == 0){
-	hmax = std::stoi(line.substr(6));
-	hmax_set = true;
-	DEBUG std::cerr << "Set hmax to " << hmax << std::endl;
-      }
-      else if(line.compare(1, 11, "X_AXIS_CHAR") == 0){
-	X_AXIS_CHAR = line.substr(13, 1).c_str()[0];
-	DEBUG std::cerr << "Set X_AXIS_CHAR to " << X_AXIS_CHAR << std::endl;
-      }
-      else if(line.compare(1, 11, "Y_AXIS_CHAR") == 0){
-	Y_AXIS_CHAR = line.substr(13, 1).c_str()[0];
-	DEBUG std::cerr << "Set Y_AXIS_CHAR to " << Y_AXIS_CHAR << std::endl;
-      }
-      else if(line.compare(1, 14, "GUIDELINE_CHAR") == 0){
-	GUIDELINE_CHAR = line.substr(16, 1).c_str()[0];
-	DEBUG std::cerr << "Set GUIDELINE_CHAR to " << GUIDELINE_CHAR
-			<< std::endl;
-      }
-      else if(line.compare(1, 10, "POINT_CHAR") == 0){
-	POINT_CHAR = line.substr(12, 1).c_str()[0];
-	DEBUG std::cerr << "Set POINT_CHAR to " << POINT_CHAR << std::endl;
-      }
-      else if(line.compare(1, 15, "X_LABEL_DENSITY") == 0){
-	X_LABEL_DENSITY = std::stoi(line.substr(17));
-	DEBUG std::cerr << "Set X_LABEL_DENSITY to " << X_LABEL_DENSITY
-			<< std::endl;
-      }
-      else if(line.compare(1, 17, "GUIDELINE_DENSITY") == 0){
-	GUIDELINE_DENSITY = std::stoi(line.substr(19));
-	DEBUG std::cerr << "Set GUIDELINE_DENSITY to " << GUIDELINE_DENSITY
-			<< std::endl;
-      }
-      else if(line.compare(1, 12, "X_AXIS_LABEL") == 0){
-	X_AXIS_LABEL = line.substr(14);
-	DEBUG std::cerr << "Set X_AXIS_LABEL to " << X_AXIS_LABEL
-			<< std::endl;
-      }
-      else if(line.compare(1, 12, "Y_AXIS_LABEL") == 0){
-	Y_AXIS_LABEL = line.substr(14);
-	DEBUG std::cerr << "Set Y_AXIS_LABEL to " << Y_AXIS_LABEL
-			<< std::endl;
-      }
-      else if(line.compare(1, 3, "bar") == 0){
-	bar_graph = true;
-	DEBUG std::cerr << "Switching to bar graph mode."
-			<< std::endl;
-      }
-      else if(line.compare(1, 14, "BAR_ZERO_POINT") == 0){
-	BAR_ZERO_POINT = true;
-	DEBUG std::cerr << "Set BAR_ZERO_POINT to " << BAR_ZERO_POINT
-			<< std::endl;
-      }
-      else if(line.compare(1, 9, "WIDTH_PAD") == 0){
-	WIDTH_PAD = std::stoi(line.substr(11));
-	DEBUG std::cerr << "Set WIDTH_PAD to " << WIDTH_PAD
-			<< std::endl;
-      }
-      else{
-	DEBUG std::cerr << "Skipping invalid option: \"" << line
-			<< "\"" << std::endl;
-      }	
-      getline(in, line);
-    }
-  }catch(const std::invalid_argument &e){
-    throw invalid_data("invalid option settings");
-  }catch(const std::out_of_range &e){
-    throw invalid_data("invalid option settings");
+  while(file_continues && is_option(line) && !is_delimiter(line)){
+    parse_option(line, opt, debug);
+    if(stats) ++stats -> lines;
+    file_continues = in.getline(line);
+  }
+  if(stats){
+    stats -> header_s += stats_clock() - start;
+    start = stats_clock();
   }
   
-  if(line == "" || !file_continues) return;
+  if(!file_continues || line == "") return false;
+  if(is_delimiter(line)) return true; // No data
 
-  std::size_t pos = line.find(",");
+  // The commas of later lines are found by in.getline()
+  std::size_t pos = line.find(',');
   
   // Check graph type
-  if(!bar_graph){
+  if(!opt.bar_graph && !opt.histogram){
     /************************/
     /** Standard data plot **/
     /************************/
+
+    // Scatter data with several y-values per line ("x, y1, y2...") is
+    // graphed as overlaid series, one per column of y-values
+    const int nseries = (pos == std::string::npos)  ?  1 :
+      1 + std::count(line.begin() + pos + 1, line.end(), ',');
+
+    // With every limit known up front, points are plotted as they are read
+    if(opt.xmin_set && opt.xmax_set && opt.ymin_set && opt.ymax_set &&
+       opt.xmin < opt.xmax && opt.ymin < opt.ymax &&
+       opt.xstep == 1 && !opt.ELIDE_GAPS && !opt.wmax_set){
+      return rasterGraph(in, line, pos, nseries, opt, buf, debug, stats);
+    }
     
     // Which kind? Basic (y) or scatter (x, y)?
     if(pos != std::string::npos){
@@ -268,64 +530,58 @@ void streamGraph(std::istream &in, const bool debug){
       /** scatter input **/
       /*******************/
 
-      DEBUG std::cerr << "parsing data as scatter input" << std::endl;
+      DEBUG std::cerr << "parsing data as scatter input with " << nseries
+		      << " series" << std::endl;
       
       // Interpret "val1, val2" as point: (x, y)
-      for(int i = 0; line != "" && file_continues;
-	  ++i, file_continues = getline(in, line)){
-	// Check if comment
-	if (line.c_str()[0] == ';'){
-	  DEBUG std::cerr << "skipping comment..." << std::endl;
-	  continue;
-	}
-	// Parse line
-	pos = line.find(",");
-	DEBUG std::cerr << "parsing line {" << line << "}" << std::endl;
-	int x, y;
-	try{
-	  x = std::stoi(line.substr(0, pos));
-	  y = std::stoi(line.substr(pos + 1));
-	}catch(const std::invalid_argument &e){
-	  throw invalid_data("invalid format");
-	}
-	DEBUG std::cerr << "into x=" << x << "\ty=" << y << std::endl;
-      
-	if(i == 0){
-	  if(!xmin_set) xmin = x;
-	  if(!xmax_set) xmax = x;
-	  if(!ymin_set) ymin = y;
-	  if(!ymax_set) ymax = y;
-	}
-	if(!xmin_set && x < xmin) xmin = x;
-	if(!xmax_set && x > xmax) xmax = x;
-	if(!ymin_set && y < ymin) ymin = y;
-	if(!ymax_set && y > ymax) ymax = y;
-	pts.push_back(std::pair<int, int>(x, y));
-	DEBUG std::cerr << "getting next line..." << std::endl;
+      // Series are not binned: each column shows all of its points
+      const bool binned = opt.xstep > 1 && nseries == 1;
+      data_part data(binned  ?  opt.xstep : 1, opt.xagg);
+      data.nseries = nseries;
+      if(!binned){
+	data.pts.swap(pts); // Reuse the points' memory
+	data.series.swap(buf.series);
       }
+      readData(in, line, pos, true, data, debug);
+      if(!opt.xmin_set) opt.xmin = data.xmin;
+      if(!opt.xmax_set) opt.xmax = data.xmax;
+      if(binned){
+	binPoints(data.binner, pts, opt.ymin_set, opt.ymax_set,
+		  &opt.ymin, &opt.ymax);
+	DEBUG std::cerr << "binned data into " << data.binner.size()
+			<< " bins" << std::endl;
+      }
+      else{
+	if(!opt.ymin_set) opt.ymin = data.ymin;
+	if(!opt.ymax_set) opt.ymax = data.ymax;
+	pts = std::move(data.pts);
+	buf.series = std::move(data.series);
+      }
+      const bool fitted = fitWidth(opt, pts, &buf.series, nseries);
 
       // Ensure graph height <= hmax
-      if(hmax_set){
-	int minstep_fit = (ymax - ymin)/hmax + 1;
-	if(ystep < minstep_fit){
-	  DEBUG std::cerr << "Adjusting ystep to " << minstep_fit
-			  << " in order to satisfy hmax" << std::endl;
-	  ystep = minstep_fit;
-	}
+      if(fitHeight(opt)){
+	DEBUG std::cerr << "Adjusting ystep to " << opt.ystep
+			<< " in order to satisfy hmax" << std::endl;
+      }
+      if(nseries == 1 && !fitted) data.binner.fill_spans(pts, opt.ystep);
+      if(stats){
+	stats -> parse_s += stats_clock() - start;
+	stats -> lines += data.lines;
+	stats -> comments += data.comments;
+	stats -> points += data.npts;
       }
     
-      std::cout << "\n\n";
+      *buf.out << "\n\n";
 
       try{
-	asciigraph ag(pts, xmin, xmax, xstep, ymin, ymax, ystep,
-		      debug,
-		      X_AXIS_CHAR, Y_AXIS_CHAR, GUIDELINE_CHAR, POINT_CHAR,
-		      X_LABEL_DENSITY, GUIDELINE_DENSITY, X_AXIS_LABEL,
-		      Y_AXIS_LABEL, WIDTH_PAD);
-	ag(std::cout);
+	asciigraph64 &ag = batchGraph(buf, buf.ag, opt, nseries, debug);
+	ag.collect_stats(stats);
+	ag(*buf.out);
       }catch(const std::logic_error &e){
 	throw invalid_data("invalid limit values");
       }
+      return data.next;
     }// end if(pos != std::string::npos)
     else{
       /*****************/
@@ -335,58 +591,52 @@ void streamGraph(std::istream &in, const bool debug){
       DEBUG std::cerr << "parsing data as basic input" << std::endl;
 
       // Interpret "val1" as value to be graphed against integer counter from 0
-      int i = 0;
-      for(; line != "" && file_continues;
-	  ++i, file_continues = getline(in, line)){
-	// Check if comment
-	if (line.c_str()[0] == ';'){
-	  DEBUG std::cerr << "skipping comment..." << std::endl;
-	  continue;
-	}
-	// Parse line
-	int y;
-	try{
-	  y = std::stoi(line);
-	}catch(const std::invalid_argument &e){
-	  throw invalid_data("invalid format");
-	}
-      
-	if(i == 0){
-	  if(!ymin_set) ymin = y;
-	  if(!ymax_set) ymax = y;
-	}
-	if(!ymin_set && y < ymin) ymin = y;
-	if(!ymax_set && y > ymax) ymax = y;
-	DEBUG std::cerr << "parsing line {" << line << "}" << " into ("
-			<< i << ", " << y << ")" << std::endl;
-	pts.push_back(std::pair<int, int>(i, y));
+      data_part data(opt.xstep, opt.xagg);
+      data.sketching = !opt.quantiles.empty();
+      if(opt.xstep == 1) data.pts.swap(pts); // Reuse the points' memory
+      readData(in, line, pos, false, data, debug);
+      int i = data.lines;
+      if(opt.xstep > 1){
+	binPoints(data.binner, pts, opt.ymin_set, opt.ymax_set,
+		  &opt.ymin, &opt.ymax);
+	DEBUG std::cerr << "binned data into " << data.binner.size()
+			<< " bins" << std::endl;
       }
-      DEBUG std::cerr << "min: " << ymin << ", max: " << ymax << std::endl;
+      else{
+	if(!opt.ymin_set) opt.ymin = data.ymin;
+	if(!opt.ymax_set) opt.ymax = data.ymax;
+	pts = std::move(data.pts);
+      }
+      DEBUG std::cerr << "min: " << opt.ymin << ", max: " << opt.ymax
+		      << std::endl;
+      if(!opt.xmin_set) opt.xmin = 0;
+      if(!opt.xmax_set) opt.xmax = i - 1;
+      const bool fitted = fitWidth(opt, pts);
 
       // Ensure graph height <= hmax
-      if(hmax_set){
-	int minstep_fit = (ymax - ymin)/hmax + 1;
-	if(ystep < minstep_fit){
-	  DEBUG std::cerr << "Adjusting ystep to " << minstep_fit
-			  << " in order to satisfy hmax" << std::endl;
-	  ystep = minstep_fit;
-	}
+      if(fitHeight(opt)){
+	DEBUG std::cerr << "Adjusting ystep to " << opt.ystep
+			<< " in order to satisfy hmax" << std::endl;
+      }
+      if(!fitted) data.binner.fill_spans(pts, opt.ystep);
+      if(stats){
+	stats -> parse_s += stats_clock() - start;
+	stats -> lines += data.lines;
+	stats -> comments += data.comments;
+	stats -> points += data.npts;
       }
     
-      std::cout << "\n\n";
+      *buf.out << "\n\n";
 
       try{
-	if(!xmin_set) xmin = 0;
-	if(!xmax_set) xmax = i - 1;
-	asciigraph ag(pts, xmin, xmax, xstep, ymin, ymax, ystep,
-		      debug,
-		      X_AXIS_CHAR, Y_AXIS_CHAR, GUIDELINE_CHAR, POINT_CHAR,
-		      X_LABEL_DENSITY, GUIDELINE_DENSITY, X_AXIS_LABEL,
-		      Y_AXIS_LABEL, WIDTH_PAD);
-	ag(std::cout);
+	asciigraph64 &ag = batchGraph(buf, buf.ag, opt, 1, debug);
+	markQuantiles(ag, opt, data.sketch);
+	ag.collect_stats(stats);
+	ag(*buf.out);
       }catch(const std::logic_error &e){
 	throw invalid_data("invalid limit values");
       }
+      return data.next;
     }
   }// end if(!bar_graph)
   else{
@@ -396,72 +646,636 @@ void streamGraph(std::istream &in, const bool debug){
 
     DEBUG std::cerr << "parsing data as bar graph" << std::endl;
 
-    X_AXIS_LABEL += "\n\n== LEGEND ==";
+    // The label of each bar, drawn in the legend
+    label_pool &labels = buf.labels;
+    labels.clear();
 
-    // lines in format "val, label"
+    // lines in format "val, label", or values counted into the bars of a
+    // histogram
     int i = 0;
+    bool next = false;
+    if(opt.histogram){
+      next = histogramData(in, line, pos, opt, buf, debug, stats);
+      i = pts.size();
+      file_continues = false;
+    }
     for(; line != "" && file_continues;
-	++i, file_continues = getline(in, line)){
+	++i, file_continues = in.getline(line, pos)){
+      if(is_delimiter(line)){
+	next = true;
+	break;
+      }
       // Check if comment
-      if (line.c_str()[0] == ';'){
+      if (line[0] == ';'){
 	DEBUG std::cerr << "skipping comment..." << std::endl;
+	if(stats) ++stats -> comments;
 	continue;
       }
       // Parse line
-      pos = line.find(",");
       DEBUG std::cerr << "parsing line {" << line << "}" << std::endl;
-      int y;
-      std::string label;
-      try{
-	y = std::stoi(line.substr(0, pos));
-	label = line.substr(pos + 1);
-      }catch(const std::invalid_argument &e){
-	throw invalid_data("invalid format");
-      }
+      int64_t y = parse_int64(line.substr(0, pos));
+      std::string_view label = line.substr(pos + 1);
       DEBUG std::cerr << "into [" << label << ": " << y << "]" << std::endl;
       
       if(i == 0){
-	if(!ymin_set) ymin = y;
-	if(!ymax_set) ymax = y;
+	if(!opt.ymin_set) opt.ymin = y;
+	if(!opt.ymax_set) opt.ymax = y;
       }
-      if(!ymin_set && y < ymin) ymin = y;
-      if(!ymax_set && y > ymax) ymax = y;
-      pts.push_back(std::pair<int, int>(i, y));
-      X_AXIS_LABEL += "\n" + std::to_string(i) + " =" + label;
+      if(!opt.ymin_set && y < opt.ymin) opt.ymin = y;
+      if(!opt.ymax_set && y > opt.ymax) opt.ymax = y;
+      pts.push_back(asciigraph64::point(i, y));
+      labels.add(label, i);
       DEBUG std::cerr << "getting next line..." << std::endl;
     }
 
     // Ensure graph height <= hmax
-    if(hmax_set){
-      int minstep_fit = (ymax - ymin)/hmax + 1;
-      if(ystep < minstep_fit){
-	DEBUG std::cerr << "Adjusting ystep to " << minstep_fit
-			<< " in order to satisfy hmax" << std::endl;
-	ystep = minstep_fit;
+    if(fitHeight(opt)){
+      DEBUG std::cerr << "Adjusting ystep to " << opt.ystep
+		      << " in order to satisfy hmax" << std::endl;
+    }
+
+    if(stats){
+      stats -> parse_s += stats_clock() - start;
+      if(!opt.histogram){ // Counted by histogramData()
+	stats -> lines += i;
+	stats -> points += pts.size();
       }
     }
 
-    std::cout << "\n\n";
+    *buf.out << "\n\n";
 
     try{
       // Set bar graph defaults (if not explicitly user-set)
-      if(X_LABEL_DENSITY == X_LABEL_DENSITY_DEFAULT){
-	X_LABEL_DENSITY = 1;
+      if(opt.X_LABEL_DENSITY == X_LABEL_DENSITY_DEFAULT){
+	opt.X_LABEL_DENSITY = 1;
       }
-      if(!ymin_set && ymin > 0){
-	ymin = 0;
+      if(!opt.ymin_set && opt.ymin > 0){
+	opt.ymin = 0;
       }
-      if(!xmin_set) xmin = 0;
-      if(!xmax_set) xmax = i - 1;
+      if(!opt.xmin_set) opt.xmin = 0;
+      if(!opt.xmax_set) opt.xmax = i - 1;
 	
-      asciigraph ag(pts, xmin, xmax, xstep, ymin, ymax, ystep,
-		    debug,
-		    X_AXIS_CHAR, Y_AXIS_CHAR, GUIDELINE_CHAR, POINT_CHAR,
-		    X_LABEL_DENSITY, GUIDELINE_DENSITY, X_AXIS_LABEL,
-		    Y_AXIS_LABEL, WIDTH_PAD, BAR_ZERO_POINT);
-      ag(std::cout, true);
+      bar_asciigraph64 &ag = batchGraph(buf, buf.bar_ag, opt, 1, debug);
+      ag.collect_stats(stats);
+      ag(*buf.out);
     }catch(const std::logic_error &e){
       throw invalid_data("invalid limit values");
     }
+    return next;
+  }
+}
+
+/* batchGraph():
+   Sets up the graph ag of the given buffers (buf.ag, or buf.bar_ag for bar
+   graphs) to draw their points with the given options, making it if this
+   is the first graph of its kind in the batch. With several series, the
+   first is drawn with POINT_CHAR and the others with SERIES_CHARS in turn.
+
+   @params
+   graph_buffers &buf           The buffers of the graph
+   std::unique_ptr<Graph> &ag   The graph of buf to use
+   const graph_options &opt     The options of the graph
+   const int nseries            The number of series (of buf.series)
+   const bool debug             Print debug info?
+
+   @return
+   Graph &                      The graph, ready to draw
+
+   @throws
+   std::logic_error             Limits invalid
+   invalid_data                 More series than SERIES_CHARS allows
+*/
+template <typename Graph>
+Graph &batchGraph(graph_buffers &buf, std::unique_ptr<Graph> &ag,
+		  const graph_options &opt, const int nseries,
+		  const bool debug){
+  const bool bar_graph = std::is_same<Graph, bar_asciigraph64>::value;
+  // Each bar has its own legend entry, so bars are never binned
+  const int64_t xstep = bar_graph  ?  1 : opt.xstep;
+  const bool zero_point = bar_graph  ?  opt.BAR_ZERO_POINT
+                                     :  BAR_ZERO_POINT_DEFAULT;
+  const bool elide = bar_graph  ?  ELIDE_GAPS_DEFAULT : opt.ELIDE_GAPS;
+  const bool braille = bar_graph  ?  BRAILLE_DEFAULT : opt.BRAILLE;
+  if(ag){
+    ag -> reset(opt.xmin, opt.xmax, xstep, opt.ymin, opt.ymax, opt.ystep,
+		debug, opt.X_AXIS_CHAR, opt.Y_AXIS_CHAR,
+		opt.GUIDELINE_CHAR, opt.POINT_CHAR, opt.X_LABEL_DENSITY,
+		opt.GUIDELINE_DENSITY, opt.X_AXIS_LABEL, opt.Y_AXIS_LABEL,
+		opt.WIDTH_PAD, zero_point, elide, opt.GAP_CHAR, braille);
+  }
+  else{
+    ag.reset(new Graph(std::vector<typename Graph::point>(),
+		       opt.xmin, opt.xmax, xstep,
+		       opt.ymin, opt.ymax, opt.ystep, debug,
+		       opt.X_AXIS_CHAR, opt.Y_AXIS_CHAR,
+		       opt.GUIDELINE_CHAR, opt.POINT_CHAR,
+		       opt.X_LABEL_DENSITY, opt.GUIDELINE_DENSITY,
+		       opt.X_AXIS_LABEL, opt.Y_AXIS_LABEL, opt.WIDTH_PAD,
+		       zero_point, elide, opt.GAP_CHAR, braille));
+  }
+  if(nseries > 1){
+    if(nseries - 1 > (int)opt.SERIES_CHARS.size() || nseries > SERIES_MAX){
+      throw invalid_data("too many series");
+    }
+    ag -> setSeries(opt.POINT_CHAR + opt.SERIES_CHARS.substr(0, nseries - 1));
+  }
+  // Bar graphs' legend follows the x-axis label
+  if(bar_graph) ag -> setLegend(&buf.labels);
+  // Trade the points for the memory of the last graph's
+  if(buf.series.empty()) ag -> setPoints(std::move(buf.pts));
+  else ag -> setPoints(std::move(buf.pts), std::move(buf.series));
+  return *ag;
+}
+
+/* rasterGraph():
+   Graphs standard (basic or scatter) data whose limits have all been set,
+   plotting each point into the graph as it is read instead of storing
+   it, so that memory use depends only on the size of the graph.
+
+   @params
+   line_reader &in              The input from which to read data
+   std::string_view line        The first line of data
+   std::size_t pos              The index of the first ',' in line
+   const int nseries            Scatter data: the y-values per line
+   graph_options &opt           The options of the graph
+   graph_buffers &buf           The buffers to graph with
+   const bool debug             Print debug info?
+   run_stats *stats             The stats to collect, if any
+
+   @return
+   bool                         Did the data end with a delimiter?
+
+   @throws
+   invalid_data                 Data invalid format or invalid limits
+*/
+bool rasterGraph(line_reader &in, std::string_view line, std::size_t pos,
+		 const int nseries, graph_options &opt, graph_buffers &buf,
+		 const bool debug, run_stats *stats){
+  // Scatter (x, y) or basic (y) data?
+  const bool scatter = pos != std::string::npos;
+  DEBUG std::cerr << "rasterizing data as "
+		  << (scatter  ?  "scatter" : "basic") << " input" << std::endl;
+
+  // Ensure graph height <= hmax
+  if(fitHeight(opt)){
+    DEBUG std::cerr << "Adjusting ystep to " << opt.ystep
+		    << " in order to satisfy hmax" << std::endl;
+  }
+
+  try{
+    buf.pts.clear();
+    asciigraph64 &ag = batchGraph(buf, buf.ag, opt, nseries, debug);
+    ag.collect_stats(stats);
+    const double start = stats  ?  stats_clock() : 0;
+
+    bool file_continues = true;
+    int64_t i = 0;
+    int comments = 0;
+    long long series_pts = 0;
+    const bool sketching = !scatter && !opt.quantiles.empty();
+    const bool fast = !debug && nseries == 1; // As for parseData()
+    quantile_sketch sketch;
+    bool next = false;
+    for(; file_continues; file_continues = in.getline(line, pos)){
+      if(line == "") break;
+      if(is_delimiter(line)){
+	next = true;
+	break;
+      }
+      const int64_t line_x = i++;
+      // Check if comment
+      if(line[0] == ';'){
+	DEBUG std::cerr << "skipping comment..." << std::endl;
+	++comments;
+      }
+      else if(nseries > 1){
+	DEBUG std::cerr << "parsing line {" << line << "}" << std::endl;
+	const int64_t x = parse_int64(line.substr(0, pos));
+	parseSeries(line, pos, nseries, [&](const int s, const int64_t y){
+	    ag.plot(x, y, s);
+	    ++series_pts;
+	  });
+      }
+      else if(scatter){
+	DEBUG std::cerr << "parsing line {" << line << "}" << std::endl;
+	ag.plot(parse_int64(line.substr(0, pos)),
+		parse_int64(line.substr(pos + 1))); // Whole line if no comma
+      }
+      else{
+	DEBUG std::cerr << "parsing line {" << line << "}" << std::endl;
+	const int64_t y = parse_int64(line);
+	ag.plot(line_x, y);
+	if(sketching) sketch.add(y);
+      }
+      if(fast){
+	i += in.read_values(scatter, i, [&](const int64_t x, const int64_t y){
+	    ag.plot(x, y);
+	    if(sketching) sketch.add(y);
+	  });
+      }
+    }
+    if(stats){
+      // Points are plotted as they are read, so this includes plotting
+      stats -> parse_s += stats_clock() - start;
+      stats -> lines += i;
+      stats -> comments += comments;
+      stats -> points += (nseries > 1)  ?  series_pts : i - comments;
+    }
+
+    *buf.out << "\n\n";
+    if(sketching) markQuantiles(ag, opt, sketch);
+    ag(*buf.out);
+    return next;
+  }catch(const std::logic_error &e){
+    throw invalid_data("invalid limit values");
+  }
+}
+
+/* histogramData():
+   Counts the values of the data starting at the given line (basic data,
+   or the y-values of scatter data) into the buckets of a histogram as they
+   are read, keeping only the buckets, and turns them into the bars of a
+   bar graph: a bar of each bucket's count, with its values in the legend.
+   The y limits are found from the counts (unless they have been set), and
+   the graph is at most HISTOGRAM_HMAX_DEFAULT rows high unless hmax is.
+
+   @params
+   line_reader &in              The input from which to read data
+   std::string_view line        The first line of data
+   std::size_t pos              The index of the first ',' in line
+   graph_options &opt           The options of the graph
+   graph_buffers &buf           Set to the bars (buf.pts), and their labels
+                                added to buf.labels
+   const bool debug             Print debug info?
+   run_stats *stats             The stats to collect, if any
+
+   @return
+   bool                         Did the data end with a delimiter?
+
+   @throws
+   invalid_data                 Data invalid format
+*/
+bool histogramData(line_reader &in, std::string_view line, std::size_t pos,
+		   graph_options &opt, graph_buffers &buf, const bool debug,
+		   run_stats *stats){
+  histogram hist(opt.binwidth, opt.bins, opt.logbins);
+  bool file_continues = true, next = false;
+  int64_t i = 0;
+  int comments = 0;
+  for(; file_continues; file_continues = in.getline(line, pos)){
+    if(line == "") break;
+    if(is_delimiter(line)){
+      next = true;
+      break;
+    }
+    ++i;
+    // Check if comment
+    if(line[0] == ';'){
+      DEBUG std::cerr << "skipping comment..." << std::endl;
+      ++comments;
+      continue;
+    }
+    hist.add(parse_int64(line.substr(pos + 1))); // Whole line if no comma
+    if(!debug){ // Lines of the same kind as this one, as for parseData()
+      i += in.read_values(pos != std::string_view::npos, 0,
+			  [&](const int64_t, const int64_t y){ hist.add(y); });
+    }
+  }
+  DEBUG std::cerr << "counted " << i - comments << " values into "
+		  << hist.size() << " buckets" << std::endl;
+
+  // Each bucket is a bar
+  std::vector<asciigraph64::point> &pts = buf.pts;
+  pts.clear();
+  for(std::size_t b = 0; b < hist.size(); ++b){
+    const int64_t count = hist.count(b);
+    if(!opt.ymax_set && (b == 0 || count > opt.ymax)) opt.ymax = count;
+    pts.push_back(asciigraph64::point(b, count));
+    buf.labels.add(' ' + hist.label(b), b);
+  }
+  if(!opt.ymin_set) opt.ymin = 0;
+  if(!opt.hmax_set){
+    opt.hmax = HISTOGRAM_HMAX_DEFAULT;
+    opt.hmax_set = true;
+  }
+  if(stats){
+    stats -> lines += i;
+    stats -> comments += comments;
+    stats -> points += i - comments;
+  }
+  return next;
+}
+
+/* readData():
+   Reads the standard (basic or scatter) data starting at the given line
+   to its end, in parallel where the input is large and already in memory.
+   The line_reader is left after the line ending the data.
+   
+   @params
+   line_reader &in              The input from which to read data
+   std::string_view line        The first line of data
+   std::size_t pos              The index of the first ',' in line
+   const bool scatter           Scatter (x, y) data? Otherwise basic (y)
+   data_part &data              The data_part to store the data in
+   const bool debug             Print debug info?
+
+   @return
+   void
+
+   @throws
+   invalid_data                 Data invalid format
+*/
+void readData(line_reader &in, std::string_view line, std::size_t pos,
+	      const bool scatter, data_part &data, const bool debug){
+  thread_pool &pool = shared_pool();
+  const char *begin = line.data(), *end = in.input_end();
+  if(!in.in_memory() || end - begin < PARALLEL_PARSE_MIN){
+    parseData(in, line, pos, scatter, 0, data, debug);
+    return;
+  }
+  end = data_end(begin, end);
+  if(debug || pool.size() < 2 || end - begin < PARALLEL_PARSE_MIN){
+    // Make room for the points at once, rather than growing (and copying)
+    if(data.binner.step() == 1 && data.nseries == 1){
+      data.pts.reserve(data.pts.size() + count_newlines(begin, end) + 1);
+    }
+    parseData(in, line, pos, scatter, 0, data, debug);
+    return;
+  }
+
+  /* Split the data at line boundaries into a few chunks per thread */
+  std::size_t nparts = std::min<std::size_t>(4*pool.size(),
+					     (end - begin)/PARALLEL_PARSE_CHUNK);
+  std::vector<const char *> bounds(1, begin);
+  for(std::size_t k = 1; k < nparts; ++k){
+    const char *p = begin + (end - begin)*k/nparts;
+    if(p < bounds.back()) p = bounds.back();
+    p = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if(p == nullptr) break;
+    bounds.push_back(p + 1);
+  }
+  bounds.push_back(end);
+  nparts = bounds.size() - 1;
+
+  /* Basic data is plotted against the line number, so each chunk must
+     know how many lines precede it: count them first */
+  std::vector<int64_t> first_x(nparts, 0);
+  if(!scatter){
+    std::vector<std::size_t> lines(nparts);
+    pool.run(nparts, [&](std::size_t k){
+	lines[k] = count_newlines(bounds[k], bounds[k + 1]);
+      });
+    for(std::size_t k = 1; k < nparts; ++k){
+      first_x[k] = first_x[k - 1] + lines[k - 1];
+    }
+  }
+
+  /* Parse the chunks */
+  std::vector<data_part> parts;
+  parts.reserve(nparts);
+  for(std::size_t k = 0; k < nparts; ++k){
+    parts.emplace_back(data.binner.step(), data.binner.kind());
+    parts.back().nseries = data.nseries;
+    parts.back().sketching = data.sketching;
+  }
+  pool.run(nparts, [&](std::size_t k){
+      try{
+	line_reader chunk(bounds[k], bounds[k + 1]);
+	std::string_view first;
+	std::size_t comma;
+	if(chunk.getline(first, comma)){
+	  parseData(chunk, first, comma, scatter, first_x[k], parts[k], false);
+	}
+      }catch(...){
+	parts[k].error = std::current_exception();
+      }
+    });
+
+  /* Merge the chunks in order, up to the end of the data */
+  for(std::size_t k = 0; k < nparts && !data.ended; ++k){
+    data_part &part = parts[k];
+    if(part.error) std::rethrow_exception(part.error);
+    if(part.npts > 0){
+      if(data.npts == 0){
+	data.xmin = part.xmin;  data.xmax = part.xmax;
+	data.ymin = part.ymin;  data.ymax = part.ymax;
+      }
+      data.xmin = std::min(data.xmin, part.xmin);
+      data.xmax = std::max(data.xmax, part.xmax);
+      data.ymin = std::min(data.ymin, part.ymin);
+      data.ymax = std::max(data.ymax, part.ymax);
+    }
+    if(data.pts.empty()) data.pts = std::move(part.pts);
+    else data.pts.insert(data.pts.end(), part.pts.begin(), part.pts.end());
+    if(data.series.empty()) data.series = std::move(part.series);
+    else{
+      data.series.insert(data.series.end(), part.series.begin(),
+			 part.series.end());
+    }
+    data.binner.merge(part.binner);
+    if(data.sketching) data.sketch.merge(part.sketch);
+    data.npts += part.npts;
+    data.lines += part.lines;
+    data.comments += part.comments;
+  }
+
+  // Continue after the line ending the data, if any
+  in.skip_to(end);
+  if(in.getline(line)){
+    data.ended = true;
+    data.next = is_delimiter(line);
+  }
+}
+
+/* markQuantiles():
+   Marks the rows of the quantiles of the options (if any) in the graph,
+   as estimated by the sketch of the y-values, labelling each with its
+   value.
+
+   @params
+   asciigraph64 &ag                 The graph to mark
+   const graph_options &opt         The options of the graph
+   const quantile_sketch &sketch    The sketch of the data graphed
+
+   @return
+   void
+*/
+static void markQuantiles(asciigraph64 &ag, const graph_options &opt,
+			  const quantile_sketch &sketch){
+  if(opt.quantiles.empty() || sketch.count() == 0) return;
+  std::vector<std::pair<int64_t, std::string>> marks;
+  for(auto it = opt.quantiles.begin(); it != opt.quantiles.end(); ++it){
+    const int64_t y = sketch.quantile(it -> first);
+    marks.push_back(std::make_pair(y, it -> second + "=" + std::to_string(y)));
+  }
+  ag.markRows(marks);
+}
+
+/* data_end():
+   Finds the end of the data starting at the given line: the first blank
+   line or delimiter in the input, which must be in memory.
+
+   @params
+   const char *p                The start of the first line of data
+   const char *end              The end of the input
+
+   @return
+   const char *                 The start of the line ending the data, or
+                                end if there is none
+*/
+static const char *data_end(const char *p, const char *end){
+  // Delimiters start with '#', which lines of data never do
+  const char *stop = p;
+  for(;;){
+    stop = static_cast<const char *>(std::memchr(stop, '#', end - stop));
+    if(stop == nullptr){
+      stop = end;
+      break;
+    }
+    const char *eol = static_cast<const char *>
+      (std::memchr(stop, '\n', end - stop));
+    if(eol == nullptr) eol = end;
+    if((stop == p || stop[-1] == '\n') &&
+       is_delimiter(std::string_view(stop, eol - stop))) break;
+    stop = eol;
+  }
+  // Blank lines before it: a '\n' right after another
+  uint64_t carry = 0; // Did the last block end with a '\n'?
+  const char *q = p;
+  for(; stop - q >= SCAN_BLOCK; q += SCAN_BLOCK){
+    const uint64_t nl = scan_block(q).newline;
+    const uint64_t blank = nl & ((nl << 1) | carry);
+    if(blank != 0) return q + __builtin_ctzll(blank);
+    carry = nl >> 63;
+  }
+  for(; q != stop; ++q){
+    if(*q == '\n' && q != p && q[-1] == '\n') return q;
+  }
+  return stop;
+}
+
+/* parseData():
+   Reads the standard (basic or scatter) data starting at the given line
+   until a blank line or the end of the input. Plain lines of values are
+   decoded straight from the input by line_reader::read_values(), and the
+   rest (comments, series, odd spacing...) a line at a time.
+
+   @params
+   line_reader &in              The input from which to read data
+   std::string_view line        The first line of data
+   std::size_t pos              The index of the first ',' in line
+   const bool scatter           Scatter (x, y) data? Otherwise basic (y)
+   const int64_t first_x        Basic data: the x-value of the first line
+   data_part &data              The data_part to add the data to
+   const bool debug             Print debug info?
+
+   @return
+   void
+
+   @throws
+   invalid_data                 Data invalid format
+*/
+void parseData(line_reader &in, std::string_view line, std::size_t pos,
+	       const bool scatter, const int64_t first_x, data_part &data,
+	       const bool debug){
+  const bool binning = data.binner.step() > 1;
+  const bool series = scatter && data.nseries > 1;
+  const bool fast = !debug && !series; // Debug output is of every line
+  bool file_continues = true;
+  for(int64_t i = first_x; file_continues;
+      file_continues = in.getline(line, pos)){
+    if(line == "" || is_delimiter(line)){
+      data.ended = true;
+      data.next = line != "";
+      break;
+    }
+    ++data.lines;
+    const int64_t line_x = i++;
+    // Check if comment
+    if (line[0] == ';'){
+      DEBUG std::cerr << "skipping comment..." << std::endl;
+      ++data.comments;
+    }
+    else if(series){
+      DEBUG std::cerr << "parsing line {" << line << "}" << std::endl;
+      const int64_t x = parse_int64(line.substr(0, pos));
+      parseSeries(line, pos, data.nseries, [&](const int s, const int64_t y){
+	  addData(data, x, y, false);
+	  data.series.push_back(s);
+	});
+    }
+    else{
+      // Parse line
+      DEBUG std::cerr << "parsing line {" << line << "}" << std::endl;
+      int64_t x, y;
+      if(scatter){
+	x = parse_int64(line.substr(0, pos));
+	y = parse_int64(line.substr(pos + 1)); // Whole line if no comma
+      }
+      else{
+	x = line_x;
+	y = parse_int64(line);
+	if(data.sketching) data.sketch.add(y);
+      }
+      DEBUG std::cerr << "into x=" << x << "\ty=" << y << std::endl;
+      addData(data, x, y, binning);
+    }
+    if(!fast) continue;
+    const std::size_t n = in.read_values(scatter, i,
+      [&](const int64_t x, const int64_t y){
+	if(!scatter && data.sketching) data.sketch.add(y);
+	addData(data, x, y, binning);
+      });
+    i += n;
+    data.lines += n;
+  }
+}
+
+// Adds the point (x, y) to data, finding its limits
+static inline void addData(data_part &data, const int64_t x,
+			   const int64_t y, const bool binning){
+  if(data.npts++ == 0){
+    data.xmin = data.xmax = x;
+    data.ymin = data.ymax = y;
+  }
+  if(x < data.xmin) data.xmin = x;
+  if(x > data.xmax) data.xmax = x;
+  if(y < data.ymin) data.ymin = y;
+  if(y > data.ymax) data.ymax = y;
+  if(binning){
+    data.binner.add(x, y); // y limits are found from the binned values
+  }
+  else{
+    data.pts.push_back(asciigraph64::point(x, y));
+  }
+}
+
+/* parseSeries():
+   Calls f(s, y) for each y-value y of series s in the series data
+   ("x, y1, y2...") of line. Empty values are missing points.
+
+   @params
+   std::string_view line        The line of data
+   std::size_t pos              The index of the first ',' in line
+   const int nseries            The number of series
+   F f                          Called for each point
+
+   @return
+   void
+
+   @throws
+   invalid_data                 Invalid value, or more values than series
+*/
+template <typename F>
+static void parseSeries(std::string_view line, std::size_t pos,
+			const int nseries, F f){
+  for(int s = 0; pos != std::string_view::npos; ++s){
+    const std::size_t next = line.find(',', pos + 1);
+    std::string_view value = line.substr(pos + 1, next - pos - 1);
+    if(value.find_first_not_of(" \t\r") != std::string_view::npos){
+      if(s >= nseries) throw invalid_data("more values than series");
+      f(s, parse_int64(value));
+    }
+    pos = next;
   }
 }
@@ -0,0 +1,154 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+#include "asciigraph.h"
+#include "linereader.h"
+#include "stats.h"
+
+
+/* struct graph_buffers:
+   The buffers of the graphs of a stream, reused from one graph to the
+   next so that a batch of graphs is drawn without reallocating them.
+   Graphs are drawn to out (std::cout unless set). Data is read as
+   int64_t, so that e.g. nanosecond latencies and epoch timestamps in
+   milliseconds are graphed as they are.
+*/
+struct graph_buffers {
+  graph_buffers() : out(&std::cout) {}
+
+  std::vector<asciigraph64::point> pts; // The points of the graph
+  std::vector<uint8_t> series;          // Of each point, with several series
+  label_pool labels;                    // Bar graphs: the label of each bar
+  std::unique_ptr<asciigraph64> ag;     // Made by the first graph drawn
+  std::unique_ptr<bar_asciigraph64> bar_ag; // ...and the first bar graph
+  std::ostream *out;                    // Where the graphs are drawn
+};
+
+
+/* Class string_buf:
+   A stream buffer appending everything written to it to a string.
+*/
+class string_buf : public std::streambuf {
+public:
+  string_buf() : dest(nullptr) {}
+  void attach(std::string *_dest){ dest = _dest; }
+
+protected:
+  int overflow(int c) override {
+    if(c == traits_type::eof()) return traits_type::not_eof(c);
+    dest -> push_back((char)c);
+    return c;
+  }
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    dest -> append(s, n);
+    return n;
+  }
+
+private:
+  std::string *dest;
+};
+
+
+/* fileGraph():
+   Graphs the data stored in the file path specified.
+
+   @params
+   const std::string &path     The path of the file containing data to graph
+   const bool debug            Print debug info?
+   run_stats *stats            The stats to collect, if any
+
+   @return
+   void
+
+   @throws
+   file_not_found              File unable to be opened
+*/
+void fileGraph(const std::string &path, const bool debug, run_stats *stats);
+
+/* fileGraph() (buffers):
+   As fileGraph(), graphing with the given buffers (to buf.out). The
+   reason a file could not be opened or graphed is given in error, not
+   written with the graphs (those drawn before it are kept).
+
+   @params
+   const std::string &path     The path of the file containing data to graph
+   graph_buffers &buf          The buffers to graph with
+   const bool debug            Print debug info?
+   run_stats *stats            The stats to collect, if any
+   std::string &error          Set to why the file was not graphed, if not
+
+   @return
+   bool                        Was the whole file graphed?
+*/
+bool fileGraph(const std::string &path, graph_buffers &buf,
+	       const bool debug, run_stats *stats, std::string &error);
+
+/* filesGraph():
+   Graphs the data of many files at once, a file at a time per thread of
+   shared_pool(), each thread graphing with buffers of its own. Files are
+   taken in turn by whichever thread is free, so a few large files do not
+   hold up the rest. The graphs of each file are written either
+     - to stdout, in the order of the files given, as though each were
+       graphed by fileGraph() in turn, or
+     - to a file of their own in outdir, named after the input file's
+       name with ".graph" appended. Files of the same name (from
+       different directories) would overwrite each other's output, so
+       none are graphed if there are any.
+   Output is written straight to its file descriptor, not through
+   std::cout, so threads only wait on each other to keep stdout in order.
+   Files which cannot be opened, graphed or written are reported on
+   stderr, and get no output file.
+
+   @params
+   const std::vector<std::string> &paths  The files to graph
+   const std::string &outdir   The directory of output files, or empty to
+                               write to stdout
+   const bool debug            Print debug info?
+   run_stats *stats            The stats to collect, if any (times are
+                               summed over the threads)
+
+   @return
+   bool                        Were all of the files graphed?
+*/
+bool filesGraph(const std::vector<std::string> &paths,
+		const std::string &outdir, const bool debug, run_stats *stats);
+
+/* streamGraph():
+   Graphs data obtained from the given line_reader. The input may hold a
+   batch of graphs, each with its own options, separated by delimiter
+   lines (GRAPH_DELIMITER); they are graphed in turn.
+
+   @params
+   line_reader &in        The input from which to read data to graph
+   const bool debug       Print debug info?
+   run_stats *stats       The stats to collect, if any
+
+   @return
+   void
+
+   @throws
+   invalid_data           Data invalid format or invalid limits
+*/
+void streamGraph(line_reader &in, const bool debug, run_stats *stats);
+
+/* streamGraph() (buffers):
+   As streamGraph(), graphing with the given buffers (to buf.out), which
+   are kept for the next input.
+*/
+void streamGraph(line_reader &in, graph_buffers &buf, const bool debug,
+		 run_stats *stats);
+
+#endif
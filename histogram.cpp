@@ -0,0 +1,66 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include <stdexcept>
+#include "histogram.h"
+#include "asciigraph_except.h"
+
+/* Makes room for the (linear) bucket of v, which is outside of the buckets
+   so far, widening the buckets first if there would be too many of them.
+   Returns the key of the bucket. */
+long long histogram::grow(const int64_t v){
+  long long key = floor_div(v, width);
+  while(max_buckets > 0 &&
+	std::max(key, lo + (long long)counts.size() - 1) - std::min(key, lo)
+	>= max_buckets){
+    widen();
+    key = floor_div(v, width);
+  }
+  if(std::max(key, lo + (long long)counts.size() - 1) - std::min(key, lo)
+     >= HISTOGRAM_BUCKETS_MAX){
+    throw invalid_data("too many histogram buckets");
+  }
+  if(key < lo){
+    counts.insert(counts.begin(), lo - key, 0);
+    lo = key;
+  }
+  else if(key >= lo + (long long)counts.size()){
+    counts.resize(key - lo + 1, 0);
+  }
+  return key;
+}
+
+/* Doubles the width of the (linear) buckets, merging each pair of buckets
+   which starts at a multiple of the new width, in place */
+void histogram::widen(){
+  const long long new_lo = floor_div(lo, 2);
+  for(std::size_t i = 0; i < counts.size(); ++i){
+    // Buckets only move down, into places already merged
+    const std::size_t j = floor_div(lo + (long long)i, 2) - new_lo;
+    if(j == i) continue;
+    counts[j] += counts[i];
+    counts[i] = 0;
+  }
+  counts.resize(floor_div(lo + (long long)counts.size() - 1, 2) - new_lo + 1);
+  lo = new_lo;
+  width *= 2;
+}
+
+std::string histogram::label(const std::size_t i) const {
+  long long a, b;
+  if(log){
+    const std::size_t k = first + i;
+    if(k == 0) return "<1";
+    a = 1LL << (k - 1);
+    b = (1LL << k) - 1;
+  }
+  else{
+    a = (lo + (long long)i)*width;
+    b = a + width - 1;
+  }
+  if(a == b) return std::to_string(a);
+  return std::to_string(a) + ".." + std::to_string(b);
+}
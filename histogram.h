@@ -0,0 +1,108 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+// The most buckets of a histogram with neither a bin width nor log buckets
+#define HISTOGRAM_BINS_DEFAULT 20
+// The most buckets of a histogram with a bin width
+#define HISTOGRAM_BUCKETS_MAX (1 << 16)
+// The height (hmax) of histograms, unless set: counts are rarely small
+#define HISTOGRAM_HMAX_DEFAULT 20
+
+
+/* Class histogram:
+   Counts values into buckets in a single streaming pass, keeping only the
+   count of each bucket, so that memory depends on the number of buckets
+   and not of values. Buckets are either
+   - linear: width values each, starting at multiples of width. Given at
+     most max_buckets buckets, width starts at 1 and doubles (merging each
+     pair of buckets) whenever the values read so far would need more.
+   - log: bucket 0 holds the values below 1 and bucket k the values
+     [2^(k-1), 2^k), so that values from microseconds to seconds take a
+     few dozen buckets.
+   Buckets are numbered from the lowest holding a value to the highest.
+*/
+class histogram {
+public:
+  /* histogram::Constructor:
+     @params
+     const int _width             Linear buckets: their width (or 0 to
+                                  start from 1, doubling as needed)
+     const int _max_buckets       Linear buckets without a width: the most
+                                  buckets kept (at least 2)
+     const bool _log              Log buckets? (ignoring the above)
+  */
+  histogram(const int _width, const int _max_buckets, const bool _log)
+    : width(_width > 0  ?  _width : 1),
+      max_buckets(_width > 0  ?  0 : std::max(_max_buckets, 2)),
+      log(_log), lo(0), first(0) {}
+
+  /* add():
+     Counts the value v into its bucket.
+
+     @throws
+     invalid_data                 More than HISTOGRAM_BUCKETS_MAX buckets
+  */
+  void add(const int64_t v){
+    if(log){
+      const std::size_t k = (v < 1)  ?  0 : 64 - __builtin_clzll(v);
+      if(counts.empty() || k < first) first = k;
+      if(k >= counts.size()) counts.resize(k + 1, 0);
+      ++counts[k];
+      return;
+    }
+    long long key = floor_div(v, width);
+    if(counts.empty()){
+      lo = key;
+      counts.push_back(0);
+    }
+    else if(key < lo || key >= lo + (long long)counts.size()) key = grow(v);
+    ++counts[key - lo];
+  }
+
+  /* size():
+     @return
+     std::size_t                  The number of buckets
+  */
+  std::size_t size() const { return counts.size() - first; }
+
+  /* count():
+     @return
+     long long                    The number of values in bucket i
+  */
+  long long count(const std::size_t i) const { return counts[first + i]; }
+
+  /* label():
+     @return
+     std::string                  The values of bucket i ("lo..hi", or
+                                  "lo" for a single value)
+  */
+  std::string label(const std::size_t i) const;
+
+private:
+  static long long floor_div(const long long a, const long long b){
+    return a/b - (a%b != 0 && (a < 0) != (b < 0));
+  }
+  long long grow(const int64_t v);
+  void widen();
+
+  long long width;
+  int max_buckets;                      // 0 if unlimited
+  bool log;
+  long long lo;                         // Linear: the first bucket's key
+  std::size_t first;                    // Log: the lowest bucket counted
+  std::vector<long long> counts;
+};
+
+#endif
@@ -0,0 +1,167 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include "linereader.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+line_reader::line_reader(const std::string &path)
+  : cur(nullptr), end(nullptr), blk(nullptr), map(nullptr), map_len(0),
+    released(nullptr), in(nullptr), fd(-1), eof(false){
+  fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0){
+    throw file_not_found("File not found");
+  }
+  struct stat st;
+  if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)){
+    map_len = st.st_size;
+    if(map_len == 0){
+      eof = true;
+      return;
+    }
+    map = mmap(nullptr, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map != MAP_FAILED){
+      madvise(map, map_len, MADV_SEQUENTIAL);
+      cur = released = static_cast<const char *>(map);
+      end = cur + map_len;
+      eof = true; // The whole file is already available
+      return;
+    }
+    map = nullptr;
+  }
+  // Not mappable: fall back to reading blocks from fd
+  buf.resize(READ_BLOCK_SIZE);
+  cur = end = buf.data();
+}
+
+line_reader::line_reader(std::istream &_in)
+  : cur(nullptr), end(nullptr), blk(nullptr), map(nullptr), map_len(0),
+    released(nullptr), in(&_in), fd(-1), eof(false), buf(READ_BLOCK_SIZE){
+  cur = end = buf.data();
+}
+
+line_reader::line_reader(const char *begin, const char *_end)
+  : cur(begin), end(_end), blk(nullptr), map(nullptr), map_len(0),
+    released(nullptr), in(nullptr), fd(-1), eof(true){}
+
+line_reader::~line_reader(){
+  if(map) munmap(map, map_len);
+  if(fd >= 0) close(fd);
+}
+
+bool line_reader::getline(std::string_view &line, std::size_t &comma){
+  if(map && cur - released >= MAP_RELEASE_SIZE) release();
+  std::size_t scanned = 0; // Bytes of the line scanned so far
+  comma = std::string_view::npos;
+  for(;;){
+    const char *p = cur + scanned;
+    if(p == end){
+      if(eof || !refill()){
+	// Last line without a terminator
+	if(cur == end) return false;
+	line = std::string_view(cur, end - cur);
+	cur = end;
+	return true;
+      }
+      continue;
+    }
+    if(blk == nullptr || p < blk || p >= blk + SCAN_BLOCK) scan_from(p);
+    const unsigned shift = p - blk;
+    const uint64_t nl = masks.newline >> shift;
+    const uint64_t cm = masks.comma >> shift;
+    if(nl != 0){
+      const unsigned n = __builtin_ctzll(nl);
+      const uint64_t cm_before = cm & ((nl & -nl) - 1);
+      if(comma == std::string_view::npos && cm_before != 0){
+	comma = scanned + __builtin_ctzll(cm_before);
+      }
+      line = std::string_view(cur, scanned + n);
+      cur = p + n + 1;
+      return true;
+    }
+    if(comma == std::string_view::npos && cm != 0){
+      comma = scanned + __builtin_ctzll(cm);
+    }
+    scanned += std::min<std::size_t>(SCAN_BLOCK - shift, end - p);
+  }
+}
+
+/* Finds the complete lines after the last line read which are already in
+   memory (reading more if there are none), at most MAP_RELEASE_SIZE bytes
+   of them, so that mapped files are still released as they are read.
+   Returns false if there are none (before a line without a terminator,
+   or one longer than that). */
+bool line_reader::lines(const char *&first, const char *&last){
+  if(map && cur - released >= MAP_RELEASE_SIZE) release();
+  for(;;){
+    const std::size_t len = std::min<std::size_t>(end - cur, MAP_RELEASE_SIZE);
+    const char *nl = (len == 0)  ?  nullptr :
+      static_cast<const char *>(memrchr(cur, '\n', len));
+    if(nl != nullptr){
+      first = cur;
+      last = nl + 1;
+      return true;
+    }
+    if(eof || !refill()) return false;
+  }
+}
+
+// Drops the pages of the mapping before cur, which have been read
+void line_reader::release(){
+  const char *base = static_cast<const char *>(map);
+  const std::size_t page = sysconf(_SC_PAGESIZE);
+  const char *stop = base + (cur - base)/page*page;
+  madvise(const_cast<char *>(released), stop - released, MADV_DONTNEED);
+  released = stop;
+}
+
+// Classifies the block starting at p, padding it if it runs past end
+void line_reader::scan_from(const char *p){
+  blk = p;
+  if(end - p >= SCAN_BLOCK){
+    masks = scan_block(p);
+  }
+  else{
+    char tail[SCAN_BLOCK] = {0};
+    std::memcpy(tail, p, end - p);
+    masks = scan_block(tail);
+  }
+}
+
+// Reads the next block of input after the unread part of buf
+bool line_reader::refill(){
+  // Move the partial line to the front, growing buf if it is all one line
+  std::size_t left = end - cur;
+  if(left > 0 && cur != buf.data()) std::memmove(buf.data(), cur, left);
+  if(buf.size() - left < READ_BLOCK_SIZE/2) buf.resize(2*buf.size());
+  cur = buf.data();
+  end = cur + left;
+  blk = nullptr; // Any scanned block has moved
+
+  std::size_t got = 0;
+  if(in){
+    in -> read(buf.data() + left, buf.size() - left);
+    got = in -> gcount();
+  }
+  else{
+    ssize_t n;
+    do{
+      n = read(fd, buf.data() + left, buf.size() - left);
+    }while(n < 0 && errno == EINTR);
+    if(n > 0) got = n;
+  }
+  if(got == 0){
+    eof = true;
+    return false;
+  }
+  end += got;
+  return true;
+}
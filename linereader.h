@@ -0,0 +1,382 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "asciigraph_except.h"
+#include "scan.h"
+
+// Size of the blocks in which unmappable input is read
+#define READ_BLOCK_SIZE (1 << 20)
+// Mapped files: the read part is dropped from memory in pieces this large
+#define MAP_RELEASE_SIZE (8 << 20)
+
+
+/* Class line_reader:
+   Splits input into lines without copying them. Regular files are memory
+   mapped and lines point directly into the mapping; streams (and files
+   which cannot be mapped, like pipes) are read in large blocks into a
+   buffer which the lines point into.
+   Lines are found with scan_block(), a block of bytes at a time, which
+   also locates the first comma in each line for the data parsers.
+   A line is only valid until the next call to getline().
+   The part of a mapped file already read is released as reading goes on,
+   so reading a file takes constant memory however large it is.
+*/
+class line_reader {
+public:
+  /* line_reader::Constructor (file):
+     @throws
+     file_not_found              File unable to be opened
+
+     @params
+     const std::string &path     The path of the file to read
+  */
+  explicit line_reader(const std::string &path);
+
+  /* line_reader::Constructor (stream):
+     @params
+     std::istream &in            The stream to read
+  */
+  explicit line_reader(std::istream &in);
+
+  /* line_reader::Constructor (memory):
+     Reads lines from text already in memory, e.g. part of another
+     line_reader's input (see in_memory()).
+
+     @params
+     const char *begin           The text to read, which must outlive
+     const char *end             the line_reader
+  */
+  line_reader(const char *begin, const char *end);
+
+  ~line_reader();
+  line_reader(const line_reader &) = delete;
+  line_reader &operator=(const line_reader &) = delete;
+
+  /* getline():
+     Reads the next line (without its line terminator), in the same manner
+     as std::getline: a final line without a terminator is still read.
+
+     @params
+     std::string_view &line      Set to the line read
+
+     @return
+     bool                        Was a line read? (false at end of input)
+  */
+  bool getline(std::string_view &line){
+    std::size_t comma;
+    return getline(line, comma);
+  }
+
+  /* getline() (with fields):
+     As getline(), also finding the first comma in the line.
+
+     @params
+     std::string_view &line      Set to the line read
+     std::size_t &comma          Set to the index of the first ',' in the
+                                 line, or std::string_view::npos if none
+
+     @return
+     bool                        Was a line read? (false at end of input)
+  */
+  bool getline(std::string_view &line, std::size_t &comma);
+
+  /* in_memory():
+     @return
+     bool                        Is all of the input after the last line
+                                 read already in memory? (e.g. mapped files)
+                                 If so it ends at input_end().
+  */
+  bool in_memory() const { return eof; }
+  const char *input_end() const { return end; }
+
+  /* skip_to():
+     Skips the input up to p, which must be in memory after the last line
+     read, e.g. to resume reading after a part of the input read by
+     another line_reader.
+
+     @params
+     const char *p               The start of the next line to read
+  */
+  void skip_to(const char *p){ cur = p; }
+
+  /* read_values():
+     Reads the plain lines of data which follow straight from the input:
+     lines of one integer y, or of two x,y (given pairs), as decoded by
+     decode_int64(). Rather than being split into lines first, the input
+     is scanned a block at a time and each value decoded from between the
+     separators found by scan_block(). Reading stops before the first line
+     which is not plain (e.g. a comment, a blank line, a delimiter, or
+     values with other spacing or more digits), which is left to
+     getline(). A final line without a terminator is left likewise.
+
+     @params
+     const bool pairs            Lines of x,y? Otherwise of y
+     int64_t x                   Lines of y: the x-value of the first,
+                                 counting up by one a line
+     F f                         Called as f(x, y) for each line
+
+     @return
+     std::size_t                 The number of lines read
+  */
+  template <typename F>
+  std::size_t read_values(const bool pairs, int64_t x, F f);
+
+private:
+  bool lines(const char *&first, const char *&last);
+  bool refill();
+  void release();
+  void scan_from(const char *p);
+
+  const char *cur, *end;  // Unread part of the mapping/buffer
+  // The block last scanned (masks bit i <=> blk[i]); null if none
+  const char *blk;
+  scan_masks masks;
+  // Mapped files
+  void *map;
+  std::size_t map_len;
+  const char *released;   // The mapping before this has been released
+  // Buffered input: from in if set, otherwise from fd
+  std::istream *in;
+  int fd;
+  bool eof;
+  std::vector<char> buf;
+};
+
+
+/* parse_int():
+   Parses an integer at the start of [first, last) in the same manner as
+   std::stoi: leading whitespace and a sign are accepted and anything after
+   the digits is ignored.
+
+   @throws
+   invalid_data                No integer found, or it does not fit an int
+
+   @params
+   const char *first           The text to parse
+   const char *last
+
+   @return
+   int                         The integer parsed
+*/
+inline int parse_int(const char *first, const char *last){
+  while(first != last && (*first == ' ' || (*first >= '\t' && *first <= '\r'))){
+    ++first;
+  }
+  if(first != last && *first == '+' &&
+     last - first > 1 && first[1] >= '0' && first[1] <= '9'){
+    ++first; // from_chars does not accept '+'
+  }
+  // Fast path: up to 9 digits cannot overflow
+  const char *p = first + (first != last && *first == '-');
+  unsigned digits = 0, n = 0;
+  for(; p != last && digits < 10; ++p, ++digits){
+    unsigned d = (unsigned char)*p - '0';
+    if(d > 9) break;
+    n = 10*n + d;
+  }
+  if(digits > 0 && digits < 10){
+    return *first == '-'  ?  -(int)n : (int)n;
+  }
+  int val;
+  auto res = std::from_chars(first, last, val);
+  if(res.ec != std::errc()){
+    throw invalid_data("invalid format");
+  }
+  return val;
+}
+
+inline int parse_int(std::string_view str){
+  return parse_int(str.data(), str.data() + str.size());
+}
+
+/* parse_int64():
+   As parse_int(), for values which need not fit an int (e.g. timestamps
+   or latencies in nanoseconds).
+
+   @throws
+   invalid_data                No integer found, or it does not fit an
+                               int64_t
+
+   @params
+   const char *first           The text to parse
+   const char *last
+
+   @return
+   int64_t                     The integer parsed
+*/
+inline int64_t parse_int64(const char *first, const char *last){
+  while(first != last && (*first == ' ' || (*first >= '\t' && *first <= '\r'))){
+    ++first;
+  }
+  if(first != last && *first == '+' &&
+     last - first > 1 && first[1] >= '0' && first[1] <= '9'){
+    ++first; // from_chars does not accept '+'
+  }
+  // Fast path: up to 18 digits cannot overflow
+  const char *p = first + (first != last && *first == '-');
+  unsigned digits = 0;
+  uint64_t n = 0;
+  for(; p != last && digits < 19; ++p, ++digits){
+    unsigned d = (unsigned char)*p - '0';
+    if(d > 9) break;
+    n = 10*n + d;
+  }
+  if(digits > 0 && digits < 19){
+    return *first == '-'  ?  -(int64_t)n : (int64_t)n;
+  }
+  int64_t val;
+  auto res = std::from_chars(first, last, val);
+  if(res.ec != std::errc()){
+    throw invalid_data("invalid format");
+  }
+  return val;
+}
+
+inline int64_t parse_int64(std::string_view str){
+  return parse_int64(str.data(), str.data() + str.size());
+}
+
+/* decode_eight():
+   @params
+   uint64_t x                  8 chars, the first in the lowest byte
+
+   @return
+   uint64_t                    The value of the chars as 8 decimal digits,
+                               or ~0 if they are not all digits
+*/
+inline uint64_t decode_eight(uint64_t x){
+  // Digits are 0x30 .. 0x39: high nibble 3, and still 3 once 6 is added
+  if(((x & 0xF0F0F0F0F0F0F0F0ULL) |
+      (((x + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+     != 0x3333333333333333ULL){
+    return ~0ULL;
+  }
+  // Combine pairs of digits, then pairs of those, then the two halves
+  x -= 0x3030303030303030ULL;
+  x = 10*x + (x >> 8);
+  return (((x & 0x000000FF000000FFULL)*0x000F424000000064ULL) +
+	  (((x >> 16) & 0x000000FF000000FFULL)*0x0000271000000001ULL)) >> 32;
+}
+
+/* decode_digits():
+   As decode_eight(), for the n (1 to 8) chars at p, which are padded
+   with leading zeros. 8 bytes are read from p.
+*/
+inline uint64_t decode_digits(const char *p, const unsigned n){
+  uint64_t x;
+  std::memcpy(&x, p, 8);
+  const unsigned shift = 8*(8 - n);
+  if(shift != 0) x = (x << shift) | (0x3030303030303030ULL >> (64 - shift));
+  return decode_eight(x);
+}
+
+/* decode_int64():
+   Decodes [first, last) if it holds just an integer: any spaces, an
+   optional '-', then 1 to 16 digits. Digits are decoded 8 at a time,
+   without a branch per digit, so that this is much faster than
+   parse_int64() on the plain values of most data (which it parses alike).
+
+   @params
+   const char *first           The text to decode
+   const char *last
+   const char *limit           The end of the readable memory holding the
+                               text (bytes up to it may be read)
+   int64_t &val                Set to the integer, if decoded
+
+   @return
+   bool                        Was the text decoded? If not, it may still
+                               be an integer parse_int64() accepts
+*/
+__attribute__((always_inline))
+inline bool decode_int64(const char *first, const char *last,
+			 const char *limit, int64_t &val){
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while(first != last && *first == ' ') ++first;
+  const bool neg = first != last && *first == '-';
+  first += neg;
+  const std::size_t n = last - first;
+  uint64_t v;
+  if(n == 0 || n > 16) return false;
+  if(n <= 8){
+    if(limit - first < 8) return false;
+    v = decode_digits(first, n);
+    if(v == ~0ULL) return false;
+  }
+  else{
+    const uint64_t hi = decode_digits(first, n - 8);
+    const uint64_t lo = decode_digits(last - 8, 8);
+    if(hi == ~0ULL || lo == ~0ULL) return false;
+    v = 100000000*hi + lo;
+  }
+  val = ((int64_t)v ^ -(int64_t)neg) + neg; // Without a branch on the sign
+  return true;
+#else
+  return false;
+#endif
+}
+
+template <typename F>
+std::size_t line_reader::read_values(const bool pairs, int64_t x, F f){
+  std::size_t n = 0;
+  const char *first, *last;
+  while(lines(first, last)){
+    const char *line = first, *comma = nullptr; // Of the line being read
+    unsigned commas = 0;                        // ...0, 1 or more (2)
+    for(const char *b = first; b < last; b += SCAN_BLOCK){
+      scan_masks m;
+      if(last - b >= SCAN_BLOCK) m = scan_block(b);
+      else{
+	char tail[SCAN_BLOCK] = {0};
+	std::memcpy(tail, b, last - b);
+	m = scan_block(tail);
+      }
+      uint64_t cm = m.comma;
+      for(uint64_t nl = m.newline; nl != 0; nl &= nl - 1){
+	// The commas of this block before the end of the line
+	const uint64_t before = cm & ((nl & -nl) - 1);
+	if(before != 0){
+	  if(comma == nullptr) comma = b + __builtin_ctzll(before);
+	  commas += 1 + ((before & (before - 1)) != 0);
+	  cm ^= before;
+	}
+	const char *eol = b + __builtin_ctzll(nl);
+	const char *end_y = (eol != line && eol[-1] == '\r')  ?  eol - 1 : eol;
+	int64_t y;
+	if(pairs  ?  commas != 1 || !decode_int64(line, comma, last, x) ||
+	             !decode_int64(comma + 1, end_y, last, y)
+	          :  commas != 0 || !decode_int64(line, end_y, last, y)){
+	  cur = line;
+	  return n;
+	}
+	f(x, y);
+	++n;
+	x += !pairs;
+	line = eol + 1;
+	comma = nullptr;
+	commas = 0;
+      }
+      if(cm != 0){ // The line goes on into the next block
+	if(comma == nullptr) comma = b + __builtin_ctzll(cm);
+	commas += 1 + ((cm & (cm - 1)) != 0);
+      }
+    }
+    cur = last;
+  }
+  return n;
+}
+
+#endif
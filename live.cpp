@@ -0,0 +1,430 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include "live.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string_view>
+#include <poll.h>
+#include <unistd.h>
+#include "asciigraph.h"
+#include "asciigraph_except.h"
+#include "linereader.h"
+#include "options.h"
+#include "xbin.h"
+
+#define DEBUG if(debug)
+
+point_ring::point_ring(std::size_t capacity)
+  : buf(capacity > 0  ?  capacity : 1), head(0), count(0) {}
+
+void point_ring::copy_to(std::vector<std::pair<int64_t, int64_t>> &pts)
+  const {
+  pts.clear();
+  std::size_t first = (head + buf.size() - count)%buf.size();
+  for(std::size_t k = 0; k < count; ++k){
+    pts.push_back(buf[(first + k)%buf.size()]);
+  }
+}
+
+void frame_diff::draw(const std::string &frame, std::string &out){
+  out.clear();
+  if(!drawn){
+    out += "\x1b[H\x1b[2J"; // Clear the screen
+    drawn = true;
+  }
+  std::size_t r = 0, start = 0, nl;
+  char move[32];
+  for(; (nl = frame.find('\n', start)) != std::string::npos;
+      ++r, start = nl + 1){
+    const std::size_t len = nl - start;
+    if(r < rows.size() && rows[r].size() == len &&
+       frame.compare(start, len, rows[r]) == 0){
+      continue;
+    }
+    if(r == rows.size()) rows.emplace_back();
+    rows[r].assign(frame, start, len);
+    std::snprintf(move, sizeof(move), "\x1b[%zu;1H", r + 1);
+    out += move;
+    out += rows[r];
+    out += "\x1b[K"; // Clear the rest of the old row
+  }
+  // Clear rows left over from a taller frame
+  for(std::size_t k = r; k < rows.size(); ++k){
+    std::snprintf(move, sizeof(move), "\x1b[%zu;1H\x1b[K", k + 1);
+    out += move;
+  }
+  rows.resize(r);
+  std::snprintf(move, sizeof(move), "\x1b[%zu;1H", r + 1);
+  out += move;
+}
+
+void frame_diff::draw_rows(const std::vector<std::size_t> &lines,
+			   const std::string &text, std::string &out){
+  out.clear();
+  std::size_t start = 0, nl;
+  char move[32];
+  for(auto it = lines.begin(); it != lines.end() &&
+	(nl = text.find('\n', start)) != std::string::npos;
+      ++it, start = nl + 1){
+    if(*it >= rows.size()) continue;
+    rows[*it].assign(text, start, nl - start);
+    std::snprintf(move, sizeof(move), "\x1b[%zu;1H", *it + 1);
+    out += move;
+    out += rows[*it];
+    out += "\x1b[K"; // Clear the rest of the old row
+  }
+  std::snprintf(move, sizeof(move), "\x1b[%zu;1H", rows.size() + 1);
+  out += move;
+}
+
+/* Class sliding_extent:
+   The least and greatest of the values in a sliding window, which values
+   leave in the order they entered. They are kept in monotonic queues, so
+   each value costs O(1) (amortized) to add and to take out.
+*/
+class sliding_extent {
+public:
+  // Adds v, the seq'th value to enter
+  void push(const uint64_t seq, const int64_t v){
+    while(!lo.empty() && lo.back().second >= v) lo.pop_back();
+    lo.push_back(std::make_pair(seq, v));
+    while(!hi.empty() && hi.back().second <= v) hi.pop_back();
+    hi.push_back(std::make_pair(seq, v));
+  }
+  // Takes out the seq'th value, the oldest in the window
+  void evict(const uint64_t seq){
+    if(!lo.empty() && lo.front().first == seq) lo.pop_front();
+    if(!hi.empty() && hi.front().first == seq) hi.pop_front();
+  }
+  int64_t min() const { return lo.front().second; }
+  int64_t max() const { return hi.front().second; }
+
+private:
+  std::deque<std::pair<uint64_t, int64_t>> lo, hi; // (seq, value)
+};
+
+/* fit_range():
+   Fits the limits [lo, hi] not set to values from vmin to vmax, with room
+   to spare of a quarter of their span (at least 1) on either side, or if
+   the values only grow (e.g. the x-values of basic data) of half of their
+   span above them. The room is cut short at the ends of int64_t.
+*/
+static void fit_range(const int64_t vmin, const int64_t vmax,
+		      const bool grows, const bool lo_set, const bool hi_set,
+		      int64_t &lo, int64_t &hi){
+  auto clamp = [](const __int128 v){
+    return (int64_t)std::min<__int128>(std::max<__int128>(v, INT64_MIN),
+				       INT64_MAX);
+  };
+  const __int128 room = ((__int128)vmax - vmin)/4 + 1;
+  if(!lo_set) lo = grows  ?  vmin : clamp(vmin - room);
+  if(!hi_set) hi = clamp(grows  ?  vmax + 2*room : vmax + room);
+}
+
+/* refit_range():
+   Are the limits [lo, hi] to be fitted to values from vmin to vmax again:
+   do some of the values fall outside of the limits not set, or would the
+   limits fitted to them be less than half as wide?
+*/
+static bool refit_range(const int64_t vmin, const int64_t vmax,
+			const bool grows, const bool lo_set, const bool hi_set,
+			const int64_t lo, const int64_t hi){
+  if((!lo_set && vmin < lo) || (!hi_set && vmax > hi)) return true;
+  int64_t fit_lo = lo, fit_hi = hi;
+  fit_range(vmin, vmax, grows, lo_set, hi_set, fit_lo, fit_hi);
+  return (__int128)fit_hi - fit_lo < ((__int128)hi - lo)/2;
+}
+
+/* Class live_view:
+   The graph of the most recent points, kept on screen across frames.
+   Points are plotted into (and unplotted out of) a single graph as they
+   enter (and leave) the window, marking the rows they are drawn in, so
+   that a frame only redraws the rows marked. The limits not set are
+   fitted to the points with room to spare, and kept until refit_range(),
+   when the whole graph is redrawn. Binned (xstep), fitted (wmax) and
+   elided graphs depend on all of their points, so they are graphed whole
+   each frame instead, still reusing the graph.
+*/
+class live_view {
+public:
+  live_view(const graph_options &_opt, const std::size_t window,
+	    const bool scatter, const bool _debug);
+
+  /* push():
+     Adds the point to the window, taking out the oldest if it is full.
+  */
+  void push(const int64_t x, const int64_t y);
+
+  /* draw():
+     Brings the screen up to date with the points of the window.
+  */
+  void draw(frame_diff &screen);
+
+private:
+  void fit(frame_diff &screen);
+  void draw_whole(frame_diff &screen);
+  void mark(const int r);
+
+  const graph_options opt;
+  const bool debug;
+  const bool incremental;    // Are points plotted as they come and go?
+  const bool grows;          // Do x-values only grow (basic data)?
+  point_ring ring;
+  uint64_t pushed;           // Points pushed so far
+  sliding_extent xs, ys;     // Of the points of the window
+  bool fitted;               // Is the graph drawn with its limits?
+  graph_options shown;       // The limits of the graph drawn
+  std::unique_ptr<asciigraph64> ag;
+  std::vector<std::pair<int64_t, int64_t>> pts;
+  std::vector<bool> marked;  // Rows to redraw...
+  std::vector<int> marks;    // ...in the order marked
+  std::vector<std::size_t> lines;
+  std::size_t top;           // The line of the graph's top row on screen
+  std::ostringstream frame;
+  std::string rows, out;
+};
+
+live_view::live_view(const graph_options &_opt, const std::size_t window,
+		     const bool scatter, const bool _debug)
+  : opt(_opt), debug(_debug),
+    incremental(_opt.xstep == 1 && !_opt.wmax_set && !_opt.ELIDE_GAPS),
+    grows(!scatter), ring(window), pushed(0), fitted(false), shown(_opt),
+    top(1 + std::count(_opt.Y_AXIS_LABEL.begin(), _opt.Y_AXIS_LABEL.end(),
+		       '\n')) {}
+
+void live_view::push(const int64_t x, const int64_t y){
+  if(ring.full()){
+    const std::pair<int64_t, int64_t> old = ring.oldest();
+    const uint64_t seq = pushed - ring.size();
+    xs.evict(seq);
+    ys.evict(seq);
+    if(fitted) mark(ag -> unplot(old.first, old.second));
+  }
+  ring.push(x, y);
+  xs.push(pushed, x);
+  ys.push(pushed, y);
+  ++pushed;
+  if(fitted) mark(ag -> plot(x, y));
+}
+
+// Marks row r (if drawn) to be redrawn
+void live_view::mark(const int r){
+  if(r < 0) return;
+  if((std::size_t)r >= marked.size()) marked.resize(r + 1, false);
+  if(marked[r]) return;
+  marked[r] = true;
+  marks.push_back(r);
+}
+
+void live_view::draw(frame_diff &screen){
+  if(!incremental){
+    draw_whole(screen);
+  }
+  else if(!fitted ||
+	  refit_range(xs.min(), xs.max(), grows, opt.xmin_set, opt.xmax_set,
+		      shown.xmin, shown.xmax) ||
+	  refit_range(ys.min(), ys.max(), false, opt.ymin_set, opt.ymax_set,
+		      shown.ymin, shown.ymax)){
+    fit(screen);
+  }
+  else{
+    // Redraw the rows marked, top down
+    std::sort(marks.begin(), marks.end());
+    rows.clear();
+    lines.clear();
+    for(auto it = marks.begin(); it != marks.end(); ++it){
+      ag -> drawRows(*it, *it + 1, rows);
+      lines.push_back(top + *it);
+      marked[*it] = false;
+    }
+    marks.clear();
+    DEBUG std::cerr << "redrew " << lines.size() << " rows" << std::endl;
+    screen.draw_rows(lines, rows, out);
+  }
+  std::cout.write(out.data(), out.size());
+  std::cout.flush();
+}
+
+/* Fits the limits to the points of the window, plots them all afresh,
+   and draws the whole graph */
+void live_view::fit(frame_diff &screen){
+  shown = opt;
+  fit_range(xs.min(), xs.max(), grows, opt.xmin_set, opt.xmax_set,
+	    shown.xmin, shown.xmax);
+  fit_range(ys.min(), ys.max(), false, opt.ymin_set, opt.ymax_set,
+	    shown.ymin, shown.ymax);
+  fitHeight(shown); // Ensure graph height <= hmax
+  DEBUG std::cerr << "fitted live graph to x [" << shown.xmin << ", "
+		  << shown.xmax << "], y [" << shown.ymin << ", "
+		  << shown.ymax << "]" << std::endl;
+
+  frame.str("");
+  try{
+    if(!ag){
+      ag.reset(new asciigraph64(std::vector<asciigraph64::point>(),
+				shown.xmin, shown.xmax, shown.xstep,
+				shown.ymin, shown.ymax, shown.ystep, debug,
+				opt.X_AXIS_CHAR, opt.Y_AXIS_CHAR,
+				opt.GUIDELINE_CHAR, opt.POINT_CHAR,
+				opt.X_LABEL_DENSITY, opt.GUIDELINE_DENSITY,
+				opt.X_AXIS_LABEL, opt.Y_AXIS_LABEL,
+				opt.WIDTH_PAD, BAR_ZERO_POINT_DEFAULT,
+				opt.ELIDE_GAPS, opt.GAP_CHAR, opt.BRAILLE));
+    }
+    else{
+      ag -> reset(shown.xmin, shown.xmax, shown.xstep,
+		  shown.ymin, shown.ymax, shown.ystep);
+    }
+    ag -> count_cells(true);
+    ring.copy_to(pts);
+    for(auto it = pts.begin(); it != pts.end(); ++it){
+      ag -> plot(it -> first, it -> second);
+    }
+    (*ag)(frame);
+  }catch(const std::logic_error &e){
+    throw invalid_data("invalid limit values");
+  }
+  fitted = true;
+  marked.assign(marked.size(), false);
+  marks.clear();
+  screen.draw(frame.str(), out);
+}
+
+/* Graphs the points of the window whole, with their limits */
+void live_view::draw_whole(frame_diff &screen){
+  graph_options g = opt;
+  ring.copy_to(pts);
+  if(!g.xmin_set) g.xmin = xs.min();
+  if(!g.xmax_set) g.xmax = xs.max();
+  if(!g.ymin_set) g.ymin = ys.min();
+  if(!g.ymax_set) g.ymax = ys.max();
+  xbinner binner(g.xstep, g.xagg);
+  if(g.xstep > 1){
+    for(auto it = pts.begin(); it != pts.end(); ++it){
+      binner.add(it -> first, it -> second);
+    }
+    binPoints(binner, pts, g.ymin_set, g.ymax_set, &g.ymin, &g.ymax);
+  }
+  // Until the data varies, give the graph some room
+  if(!g.xmax_set && g.xmax <= g.xmin) g.xmax = g.xmin + 1;
+  if(!g.ymax_set && g.ymax <= g.ymin) g.ymax = g.ymin + 1;
+
+  const bool fitted_width = fitWidth(g, pts);
+
+  fitHeight(g); // Ensure graph height <= hmax
+  if(!fitted_width) binner.fill_spans(pts, g.ystep);
+
+  frame.str("");
+  try{
+    if(!ag){
+      ag.reset(new asciigraph64(std::move(pts), g.xmin, g.xmax, g.xstep,
+				g.ymin, g.ymax, g.ystep, debug,
+				g.X_AXIS_CHAR, g.Y_AXIS_CHAR,
+				g.GUIDELINE_CHAR, g.POINT_CHAR,
+				g.X_LABEL_DENSITY, g.GUIDELINE_DENSITY,
+				g.X_AXIS_LABEL, g.Y_AXIS_LABEL, g.WIDTH_PAD,
+				BAR_ZERO_POINT_DEFAULT, g.ELIDE_GAPS,
+				g.GAP_CHAR, g.BRAILLE));
+    }
+    else{
+      ag -> reset(g.xmin, g.xmax, g.xstep, g.ymin, g.ymax, g.ystep);
+      ag -> setPoints(std::move(pts)); // pts is left with the old memory
+    }
+    (*ag)(frame);
+  }catch(const std::logic_error &e){
+    throw invalid_data("invalid limit values");
+  }
+  screen.draw(frame.str(), out);
+}
+
+void liveGraph(const int fd, const std::size_t window, const bool debug){
+  typedef std::chrono::steady_clock clock;
+  graph_options opt;
+  std::unique_ptr<live_view> view; // Made once the options are read
+  frame_diff screen;
+
+  std::vector<char> buf(READ_BLOCK_SIZE);
+  std::size_t len = 0;
+  bool header = true, scatter = false, dirty = false, eof = false;
+  int next_x = 0;
+  clock::time_point next_frame = clock::now();
+
+  // Handles one complete line of input
+  auto handle = [&](std::string_view line){
+    if(header && is_option(line)){
+      parse_option(line, opt, debug);
+      return;
+    }
+    if(line == "") return; // The data never ends early while live
+    if(header){
+      header = false;
+      if(opt.bar_graph){
+	throw invalid_data("bar graphs cannot be drawn live");
+      }
+      scatter = line.find(',') != std::string_view::npos;
+      DEBUG std::cerr << "parsing live data as "
+		      << (scatter  ?  "scatter" : "basic") << " input"
+		      << std::endl;
+      view.reset(new live_view(opt, window, scatter, debug));
+    }
+    const int i = next_x++;
+    if(line[0] == ';') return;
+    if(scatter){
+      std::size_t pos = line.find(',');
+      view -> push(parse_int64(line.substr(0, pos)),
+		   parse_int64(line.substr(pos + 1))); // Whole line if no comma
+    }
+    else{
+      view -> push(i, parse_int64(line));
+    }
+    dirty = true;
+  };
+
+  while(!eof){
+    int timeout = -1; // Nothing to draw: wait for input
+    if(dirty){
+      timeout = std::max<long long>(0,
+	std::chrono::duration_cast<std::chrono::milliseconds>
+	(next_frame - clock::now()).count());
+    }
+    pollfd pfd = {fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, timeout);
+    if(ready < 0 && errno != EINTR) break;
+    if(ready > 0){
+      if(len == buf.size()) buf.resize(2*buf.size());
+      ssize_t n = read(fd, buf.data() + len, buf.size() - len);
+      if(n < 0 && errno == EINTR) continue;
+      if(n <= 0){
+	eof = true;
+	if(len > 0) handle(std::string_view(buf.data(), len)); // Last line
+      }
+      else{
+	len += n;
+	const char *p = buf.data(), *end = p + len, *nl;
+	while((nl = static_cast<const char *>(std::memchr(p, '\n', end - p)))){
+	  handle(std::string_view(p, nl - p));
+	  p = nl + 1;
+	}
+	len = end - p;
+	std::memmove(buf.data(), p, len);
+      }
+    }
+    // Draw at most once per frame interval, and once more at the end
+    clock::time_point now = clock::now();
+    if(dirty && (eof || now >= next_frame)){
+      view -> draw(screen);
+      dirty = false;
+      next_frame = now + std::chrono::milliseconds(1000/opt.fps);
+    }
+  }
+}
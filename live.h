@@ -0,0 +1,115 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Live mode: the number of most recent points graphed
+#define LIVE_WINDOW_DEFAULT 60
+
+
+/* Class point_ring:
+   A fixed-size ring buffer holding the most recent points added; once
+   full, each point added replaces the oldest.
+*/
+class point_ring {
+public:
+  /* point_ring::Constructor:
+     @params
+     std::size_t capacity        The number of points kept (at least 1)
+  */
+  explicit point_ring(std::size_t capacity);
+
+  void push(const int64_t x, const int64_t y){
+    buf[head] = std::pair<int64_t, int64_t>(x, y);
+    if(++head == buf.size()) head = 0;
+    if(count < buf.size()) ++count;
+  }
+  std::size_t size() const { return count; }
+  bool full() const { return count == buf.size(); }
+  // The oldest point held, replaced by the next push() if full()
+  const std::pair<int64_t, int64_t> &oldest() const {
+    return buf[(head + buf.size() - count)%buf.size()];
+  }
+
+  /* copy_to():
+     @params
+     std::vector<...> &pts       Set to the points, oldest first
+  */
+  void copy_to(std::vector<std::pair<int64_t, int64_t>> &pts) const;
+
+private:
+  std::vector<std::pair<int64_t, int64_t>> buf;
+  std::size_t head, count;  // Next slot to write, points held
+};
+
+
+/* Class frame_diff:
+   Keeps a terminal showing the latest of a series of frames. Only the
+   rows which differ from the frame on screen are rewritten, using ANSI
+   cursor movement, so redrawing a mostly unchanged frame is cheap.
+*/
+class frame_diff {
+public:
+  frame_diff() : drawn(false) {}
+
+  /* draw():
+     @params
+     const std::string &frame    The new frame, as lines ending in '\n'
+     std::string &out            Set to the terminal output updating the
+                                 screen from the previous frame
+  */
+  void draw(const std::string &frame, std::string &out);
+
+  /* draw_rows():
+     Rewrites only the given rows of the frame on screen (e.g. those a
+     few points were drawn in), leaving the others as they are without
+     comparing them.
+
+     @params
+     const std::vector<std::size_t> &lines  The rows rewritten (counted
+                                            from 0), within the frame
+     const std::string &text     Their new text, as lines ending in '\n'
+     std::string &out            Set to the terminal output
+  */
+  void draw_rows(const std::vector<std::size_t> &lines,
+		 const std::string &text, std::string &out);
+
+private:
+  std::vector<std::string> rows;  // The rows on screen
+  bool drawn;
+};
+
+
+/* liveGraph():
+   Graphs standard (basic or scatter) data as it arrives on the given file
+   descriptor (e.g. from `tail -f`), redrawing the graph of the most
+   recent points at most opt.fps times a second until the input ends.
+   Options are read from the start of the input as usual. Limits not set
+   are fitted to the points with room to spare, and only refitted once
+   points fall outside of them (or fill little of them), so that in
+   between, a frame only redraws the rows points entered or left.
+
+   @params
+   const int fd                The input to read data from
+   const std::size_t window    The number of most recent points to graph
+   const bool debug            Print debug info?
+
+   @return
+   void
+
+   @throws
+   invalid_data                Data invalid format or invalid limits
+*/
+void liveGraph(const int fd, const std::size_t window, const bool debug);
+
+#endif
@@ -0,0 +1,273 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include "options.h"
+#include "asciigraph_except.h"
+
+#define DEBUG if(debug)
+
+void parse_option(std::string_view line, graph_options &opt, const bool debug){
+  try{
+    std::string option(line); // Option lines are few, so handled as strings
+    if(option.c_str()[0] == ';'){
+      DEBUG std::cerr << "skipping comment..." << std::endl;
+    }
+    else if(option.compare(1, 5, "ystep") == 0){
+      opt.ystep = std::stoll(option.substr(7));
+      if(opt.ystep <= 0) opt.ystep = 1;
+      DEBUG std::cerr << "Set ystep to " << opt.ystep << std::endl;
+    }
+    else if(option.compare(1, 5, "xstep") == 0){
+      opt.xstep = std::stoll(option.substr(7));
+      if(opt.xstep <= 0) opt.xstep = 1;
+      DEBUG std::cerr << "Set xstep to " << opt.xstep << std::endl;
+    }
+    else if(option.compare(1, 4, "xagg") == 0){
+      if(!parse_aggregator(option.substr(6), &opt.xagg)){
+	throw invalid_data("invalid option settings");
+      }
+      DEBUG std::cerr << "Set xagg to " << option.substr(6) << std::endl;
+    }
+    else if(option.compare(1, 4, "ymin") == 0){
+      opt.ymin = std::stoll(option.substr(6));
+      opt.ymin_set = true;
+      DEBUG std::cerr << "Set ymin to " << opt.ymin << std::endl;
+    }
+    else if(option.compare(1, 4, "ymax") == 0){
+      opt.ymax = std::stoll(option.substr(6));
+      opt.ymax_set = true;
+      DEBUG std::cerr << "Set ymax to " << opt.ymax << std::endl;
+    }
+    else if(option.compare(1, 4, "xmin") == 0){
+      opt.xmin = std::stoll(option.substr(6));
+      opt.xmin_set = true;
+      DEBUG std::cerr << "Set xmin to " << opt.xmin << std::endl;
+    }
+    else if(option.compare(1, 4, "xmax") == 0){
+      opt.xmax = std::stoll(option.substr(6));
+      opt.xmax_set = true;
+      DEBUG std::cerr << "Set xmax to " << opt.xmax << std::endl;
+    }
+    else if(option.compare(1, 4, "hmax") == 0){
+      opt.hmax = std::stoi(option.substr(6));
+      opt.hmax_set = true;
+      DEBUG std::cerr << "Set hmax to " << opt.hmax << std::endl;
+    }
+    else if(option.compare(1, 4, "wmax") == 0){
+      opt.wmax = std::stoi(option.substr(6));
+      opt.wmax_set = opt.wmax > 0;
+      DEBUG std::cerr << "Set wmax to " << opt.wmax << std::endl;
+    }
+    else if(option.compare(1, 11, "X_AXIS_CHAR") == 0){
+      opt.X_AXIS_CHAR = option.substr(13, 1).c_str()[0];
+      DEBUG std::cerr << "Set X_AXIS_CHAR to " << opt.X_AXIS_CHAR << std::endl;
+    }
+    else if(option.compare(1, 11, "Y_AXIS_CHAR") == 0){
+      opt.Y_AXIS_CHAR = option.substr(13, 1).c_str()[0];
+      DEBUG std::cerr << "Set Y_AXIS_CHAR to " << opt.Y_AXIS_CHAR << std::endl;
+    }
+    else if(option.compare(1, 14, "GUIDELINE_CHAR") == 0){
+      opt.GUIDELINE_CHAR = option.substr(16, 1).c_str()[0];
+      DEBUG std::cerr << "Set GUIDELINE_CHAR to " << opt.GUIDELINE_CHAR
+		<< std::endl;
+    }
+    else if(option.compare(1, 10, "POINT_CHAR") == 0){
+      opt.POINT_CHAR = option.substr(12, 1).c_str()[0];
+      DEBUG std::cerr << "Set POINT_CHAR to " << opt.POINT_CHAR << std::endl;
+    }
+    else if(option.compare(1, 12, "SERIES_CHARS") == 0){
+      opt.SERIES_CHARS = option.substr(14);
+      DEBUG std::cerr << "Set SERIES_CHARS to " << opt.SERIES_CHARS
+		<< std::endl;
+    }
+    else if(option.compare(1, 15, "X_LABEL_DENSITY") == 0){
+      opt.X_LABEL_DENSITY = std::stoi(option.substr(17));
+      DEBUG std::cerr << "Set X_LABEL_DENSITY to " << opt.X_LABEL_DENSITY
+		<< std::endl;
+    }
+    else if(option.compare(1, 17, "GUIDELINE_DENSITY") == 0){
+      opt.GUIDELINE_DENSITY = std::stoi(option.substr(19));
+      DEBUG std::cerr << "Set GUIDELINE_DENSITY to " << opt.GUIDELINE_DENSITY
+		<< std::endl;
+    }
+    else if(option.compare(1, 12, "X_AXIS_LABEL") == 0){
+      opt.X_AXIS_LABEL = option.substr(14);
+      DEBUG std::cerr << "Set X_AXIS_LABEL to " << opt.X_AXIS_LABEL
+		<< std::endl;
+    }
+    else if(option.compare(1, 12, "Y_AXIS_LABEL") == 0){
+      opt.Y_AXIS_LABEL = option.substr(14);
+      DEBUG std::cerr << "Set Y_AXIS_LABEL to " << opt.Y_AXIS_LABEL
+		<< std::endl;
+    }
+    else if(option.compare(1, 3, "bar") == 0){
+      opt.bar_graph = true;
+      DEBUG std::cerr << "Switching to bar graph mode."
+		<< std::endl;
+    }
+    else if(option.compare(1, 9, "quantiles") == 0){
+      // Percentiles, separated by commas or spaces
+      opt.quantiles.clear();
+      const char *sep = ", \t\r";
+      std::size_t pos = 10;
+      while((pos = option.find_first_not_of(sep, pos)) != std::string::npos){
+	const std::size_t end = option.find_first_of(sep, pos);
+	const std::string p = option.substr(pos, end - pos);
+	const double q = std::stod(p);
+	if(!(q >= 0 && q <= 100)) throw invalid_data("invalid option settings");
+	opt.quantiles.push_back(std::make_pair(q/100, "p" + p));
+	pos = end;
+      }
+      DEBUG std::cerr << "Marking " << opt.quantiles.size() << " quantiles"
+		      << std::endl;
+    }
+    else if(option.compare(1, 9, "histogram") == 0){
+      opt.histogram = true;
+      DEBUG std::cerr << "Switching to histogram mode." << std::endl;
+    }
+    else if(option.compare(1, 4, "bins") == 0){
+      opt.bins = std::stoi(option.substr(6));
+      DEBUG std::cerr << "Set bins to " << opt.bins << std::endl;
+    }
+    else if(option.compare(1, 8, "binwidth") == 0){
+      opt.binwidth = std::stoi(option.substr(10));
+      DEBUG std::cerr << "Set binwidth to " << opt.binwidth << std::endl;
+    }
+    else if(option.compare(1, 7, "logbins") == 0){
+      opt.logbins = true;
+      DEBUG std::cerr << "Using log-spaced histogram buckets." << std::endl;
+    }
+    else if(option.compare(1, 14, "BAR_ZERO_POINT") == 0){
+      opt.BAR_ZERO_POINT = true;
+      DEBUG std::cerr << "Set BAR_ZERO_POINT to " << opt.BAR_ZERO_POINT
+		<< std::endl;
+    }
+    else if(option.compare(1, 5, "elide") == 0){
+      opt.ELIDE_GAPS = true;
+      DEBUG std::cerr << "Eliding gaps between populated columns."
+		<< std::endl;
+    }
+    else if(option.compare(1, 8, "GAP_CHAR") == 0){
+      opt.GAP_CHAR = option.substr(10, 1).c_str()[0];
+      DEBUG std::cerr << "Set GAP_CHAR to " << opt.GAP_CHAR << std::endl;
+    }
+    else if(option.compare(1, 7, "braille") == 0){
+      opt.BRAILLE = true;
+      DEBUG std::cerr << "Drawing points as Braille dots." << std::endl;
+    }
+    else if(option.compare(1, 3, "fps") == 0){
+      opt.fps = std::stoi(option.substr(5));
+      if(opt.fps <= 0) opt.fps = LIVE_FPS_DEFAULT;
+      DEBUG std::cerr << "Set fps to " << opt.fps << std::endl;
+    }
+    else if(option.compare(1, 9, "WIDTH_PAD") == 0){
+      opt.WIDTH_PAD = std::stoi(option.substr(11));
+      DEBUG std::cerr << "Set WIDTH_PAD to " << opt.WIDTH_PAD
+		<< std::endl;
+    }
+    else{
+      DEBUG std::cerr << "Skipping invalid option: \"" << option
+		<< "\"" << std::endl;
+    }	
+  }catch(const std::invalid_argument &e){
+    throw invalid_data("invalid option settings");
+  }catch(const std::out_of_range &e){
+    throw invalid_data("invalid option settings");
+  }
+}
+
+void binPoints(const xbinner &binner,
+	       std::vector<std::pair<int64_t, int64_t>> &pts,
+	       const bool ymin_set, const bool ymax_set,
+	       int64_t *ymin, int64_t *ymax){
+  binner.aggregate(pts);
+  for(auto it = pts.begin(); it != pts.end(); ++it){
+    if(it == pts.begin()){
+      if(!ymin_set) *ymin = it -> second;
+      if(!ymax_set) *ymax = it -> second;
+    }
+    if(!ymin_set && it -> second < *ymin) *ymin = it -> second;
+    if(!ymax_set && it -> second > *ymax) *ymax = it -> second;
+  }
+  // Like bar graphs, counts are shown from zero
+  if(binner.counting() && !ymin_set && *ymin > 0) *ymin = 0;
+}
+
+// The number of columns of xstep x-values from xmin to xmax (found
+// exactly, as it may not fit 64 bits)
+static __int128 columns(const graph_options &opt, const __int128 xstep){
+  auto bin = [xstep](const __int128 x){ return x/xstep - (x%xstep < 0); };
+  return bin(opt.xmax) - bin(opt.xmin) + 1;
+}
+
+bool fitHeight(graph_options &opt){
+  if(!opt.hmax_set || opt.ymax < opt.ymin) return false;
+  const __int128 minstep_fit =
+    ((__int128)opt.ymax - opt.ymin)/opt.hmax + 1;
+  if(minstep_fit <= opt.ystep) return false;
+  if(minstep_fit > INT64_MAX) throw invalid_data("invalid limit values");
+  opt.ystep = (int64_t)minstep_fit;
+  return true;
+}
+
+bool fitWidth(graph_options &opt,
+	      std::vector<std::pair<int64_t, int64_t>> &pts,
+	      std::vector<uint8_t> *series, const int nseries){
+  if(!opt.wmax_set || opt.xmin > opt.xmax ||
+     columns(opt, opt.xstep) <= opt.wmax){
+    return false;
+  }
+  // The smallest multiple of xstep fitting the x-values into wmax columns
+  const __int128 span = (__int128)opt.xmax - opt.xmin + 1;
+  const __int128 per = (__int128)opt.xstep*opt.wmax;
+  __int128 xstep = opt.xstep*((span + per - 1)/per);
+  while(columns(opt, xstep) > opt.wmax) xstep += opt.xstep;
+  if(xstep > INT64_MAX) throw invalid_data("invalid limit values");
+  opt.xstep = (int64_t)xstep;
+
+  typedef std::pair<int64_t, int64_t> point;
+  auto by_x = [](const point &a, const point &b){
+    return a.first < b.first;
+  };
+  if(series == nullptr || series -> empty() || nseries == 1){
+    if(!std::is_sorted(pts.begin(), pts.end(), by_x) &&
+       !group_bins(pts, 0, pts.size(), opt.xstep)){
+      std::stable_sort(pts.begin(), pts.end(), by_x);
+    }
+    pts.resize(downsample_lttb(pts, 0, pts.size(), opt.xstep));
+    return true;
+  }
+
+  // Gather the points of each series in turn and downsample each
+  std::vector<std::size_t> start(nseries + 1, 0);
+  for(auto it = series -> begin(); it != series -> end(); ++it){
+    ++start[*it + 1];
+  }
+  for(int s = 0; s < nseries; ++s) start[s + 1] += start[s];
+  std::vector<point> gathered(pts.size());
+  std::vector<std::size_t> next(start.begin(), start.end() - 1);
+  for(std::size_t i = 0; i < pts.size(); ++i){
+    gathered[next[(*series)[i]]++] = pts[i];
+  }
+  pts.clear();
+  series -> clear();
+  for(int s = 0; s < nseries; ++s){
+    auto first = gathered.begin() + start[s],
+         last  = gathered.begin() + start[s + 1];
+    if(!std::is_sorted(first, last, by_x) &&
+       !group_bins(gathered, start[s], start[s + 1], opt.xstep)){
+      std::stable_sort(first, last, by_x);
+    }
+    const std::size_t end = downsample_lttb(gathered, start[s], start[s + 1],
+					    opt.xstep);
+    pts.insert(pts.end(), first, gathered.begin() + end);
+    series -> insert(series -> end(), end - start[s], s);
+  }
+  return true;
+}
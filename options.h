@@ -0,0 +1,155 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include "asciigraph.h"
+#include "xbin.h"
+#include "histogram.h"
+#include <vector>
+#include <utility>
+
+// Live mode: the most frames drawn per second
+#define LIVE_FPS_DEFAULT 10
+// The line ending a graph of a stream, after which the next graph begins
+#define GRAPH_DELIMITER "#next"
+
+
+/* struct graph_options:
+   The settings of a graph, as given by the option lines at the start of
+   its data (see the readme). Limits which are not set are found from
+   the data.
+*/
+struct graph_options {
+  int64_t xmin  = -1, xmax  = -1;       // Limits and steps of the data
+  int64_t ymin  = 0,  ymax  = 0;
+  int64_t xstep = 1,  ystep = 1;
+  int hmax  = 0,  wmax  = 0;
+  int bins  = HISTOGRAM_BINS_DEFAULT, binwidth = 0;
+  int fps   = LIVE_FPS_DEFAULT;
+  aggregator xagg = AGGREGATOR_DEFAULT;
+  bool xmin_set = false,  xmax_set  = false,
+       ymin_set = false,  ymax_set  = false,
+       hmax_set = false,  wmax_set  = false,
+       bar_graph = false, histogram = false,
+       logbins  = false,
+              BAR_ZERO_POINT    = BAR_ZERO_POINT_DEFAULT,
+              ELIDE_GAPS        = ELIDE_GAPS_DEFAULT,
+              BRAILLE           = BRAILLE_DEFAULT;
+  char        X_AXIS_CHAR       = X_AXIS_CHAR_DEFAULT,
+              Y_AXIS_CHAR       = Y_AXIS_CHAR_DEFAULT,
+              GUIDELINE_CHAR    = GUIDELINE_CHAR_DEFAULT,
+              POINT_CHAR        = POINT_CHAR_DEFAULT,
+              GAP_CHAR          = GAP_CHAR_DEFAULT;
+  int         X_LABEL_DENSITY   = X_LABEL_DENSITY_DEFAULT,
+              GUIDELINE_DENSITY = GUIDELINE_DENSITY_DEFAULT,
+              WIDTH_PAD         = WIDTH_PAD_DEFAULT;
+  // Basic data: the quantiles (in [0, 1]) to mark, with their labels
+  std::vector<std::pair<double, std::string>> quantiles;
+  std::string X_AXIS_LABEL      = X_AXIS_LABEL_DEFAULT,
+              Y_AXIS_LABEL      = Y_AXIS_LABEL_DEFAULT,
+              SERIES_CHARS      = SERIES_CHARS_DEFAULT;
+};
+
+/* is_option():
+   @return
+   bool                       Is the line an option (or comment) line?
+*/
+inline bool is_option(std::string_view line){
+  return line != "" && (line[0] == '#' || line[0] == ';');
+}
+
+/* is_delimiter():
+   @return
+   bool                       Is the line the delimiter between graphs?
+*/
+inline bool is_delimiter(std::string_view line){
+  return line == GRAPH_DELIMITER;
+}
+
+/* parse_option():
+   Applies a single option line ("#name value") to the given options.
+   Comments (";...") and unrecognized options are skipped.
+
+   @params
+   std::string_view line      The option line
+   graph_options &opt         The options to update
+   const bool debug           Print debug info?
+
+   @return
+   void
+
+   @throws
+   invalid_data               Invalid option value
+*/
+void parse_option(std::string_view line, graph_options &opt, const bool debug);
+
+/* binPoints():
+   Replaces pts with the aggregated points of the given binner and finds
+   the y limits of the aggregated points (unless they have been set).
+   Counts are always graphed from 0.
+
+   @params
+   const xbinner &binner                    The binned data
+   std::vector<...> &pts                    Set to the aggregated points
+   const bool ymin_set                      Has ymin been set?
+   const bool ymax_set                      Has ymax been set?
+   int64_t *ymin                            The y limits to be updated
+   int64_t *ymax
+
+   @return
+   void
+*/
+void binPoints(const xbinner &binner,
+	       std::vector<std::pair<int64_t, int64_t>> &pts,
+	       const bool ymin_set, const bool ymax_set,
+	       int64_t *ymin, int64_t *ymax);
+
+/* fitHeight():
+   Ensures that the graph is at most hmax rows high (if hmax is set),
+   raising ystep to fit the y limits into hmax rows. The span of the
+   limits is found exactly, however far apart they are.
+
+   @throws
+   invalid_data                             The step would not fit 64 bits
+
+   @params
+   graph_options &opt                       The options of the graph
+
+   @return
+   bool                                     Was ystep raised?
+*/
+bool fitHeight(graph_options &opt);
+
+/* fitWidth():
+   Ensures that the graph is at most wmax columns wide (if wmax is set),
+   raising xstep to a multiple of itself and downsampling the points to
+   one per column (of each series) with downsample_lttb(), after grouping
+   unsorted points into their columns with group_bins(). The x limits
+   must be known. Points of each series are downsampled on their own.
+
+   @throws
+   invalid_data                             The step would not fit 64 bits
+
+   @params
+   graph_options &opt                       The options of the graph
+   std::vector<...> &pts                    The points of the graph
+   std::vector<uint8_t> *series = nullptr   The series of each point, if
+                                            several
+   const int nseries = 1                    The number of series
+
+   @return
+   bool                                     Were the points downsampled?
+*/
+bool fitWidth(graph_options &opt,
+	      std::vector<std::pair<int64_t, int64_t>> &pts,
+	      std::vector<uint8_t> *series = nullptr, const int nseries = 1);
+
+#endif
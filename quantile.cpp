@@ -0,0 +1,84 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include "quantile.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// The most values of level h: k at the top level, 2/3 as many each level down
+std::size_t quantile_sketch::capacity(const std::size_t h) const {
+  const double c = k*std::pow(2.0/3, (double)(levels.size() - 1 - h));
+  return std::max<std::size_t>(2, (std::size_t)std::ceil(c));
+}
+
+// Compacts full levels until the values kept fit into the levels again
+void quantile_sketch::compress(){
+  while(size >= max_size){
+    std::size_t h = 0;
+    while(levels[h].size() < capacity(h)) ++h;
+    compact(h);
+  }
+}
+
+/* Moves every other value of the sorted level h up a level, where each
+   weighs twice as much, so the total weight is kept */
+void quantile_sketch::compact(const std::size_t h){
+  if(h + 1 == levels.size()){
+    levels.emplace_back();
+    // Every level's room changes with the number of levels
+    max_size = 0;
+    for(std::size_t l = 0; l < levels.size(); ++l) max_size += capacity(l);
+  }
+  std::vector<int64_t> &level = levels[h], &up = levels[h + 1];
+  std::sort(level.begin(), level.end());
+  // An odd value out stays, so that pairs are compacted
+  const std::size_t odd = level.size()%2;
+  coin ^= coin << 13;
+  coin ^= coin >> 7;
+  coin ^= coin << 17;
+  for(std::size_t i = odd + (coin & 1); i < level.size(); i += 2){
+    up.push_back(level[i]);
+  }
+  size -= (level.size() - odd)/2;
+  level.resize(odd);
+}
+
+void quantile_sketch::merge(const quantile_sketch &other){
+  if(other.levels.size() > levels.size()){
+    levels.resize(other.levels.size());
+    max_size = 0;
+    for(std::size_t l = 0; l < levels.size(); ++l) max_size += capacity(l);
+  }
+  for(std::size_t h = 0; h < other.levels.size(); ++h){
+    levels[h].insert(levels[h].end(), other.levels[h].begin(),
+		     other.levels[h].end());
+  }
+  n += other.n;
+  size += other.size;
+  compress();
+}
+
+int64_t quantile_sketch::quantile(const double q) const {
+  if(n == 0) return 0;
+  // The values kept, with their weights, in order
+  std::vector<std::pair<int64_t, long long>> kept;
+  long long total = 0;
+  for(std::size_t h = 0; h < levels.size(); ++h){
+    for(auto it = levels[h].begin(); it != levels[h].end(); ++it){
+      kept.push_back(std::make_pair(*it, 1LL << h));
+      total += 1LL << h;
+    }
+  }
+  std::sort(kept.begin(), kept.end());
+  const long long rank = std::max<long long>(1, (long long)std::ceil(q*total));
+  long long seen = 0;
+  for(auto it = kept.begin(); it != kept.end(); ++it){
+    seen += it -> second;
+    if(seen >= rank) return it -> first;
+  }
+  return kept.back().first;
+}
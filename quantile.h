@@ -0,0 +1,76 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef QUANTILE_H
+#define QUANTILE_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// The accuracy of quantile sketches: the rank error is about 1.7/K
+#define QUANTILE_SKETCH_K 200
+
+
+/* Class quantile_sketch:
+   Estimates quantiles of a stream of values from a single pass, in memory
+   independent of the number of values (a KLL sketch). Values are kept in
+   levels, each value of level h standing for 2^h values read. Levels are
+   shorter further down (by 2/3 a level, from K at the top), and once the
+   sketch holds as many values as all of its levels can, the lowest full
+   level is sorted and every other value (from a random start) moves up a
+   level, so about 3*K values are kept. Sketches of parts of a stream can
+   be merged. Until the sketch first fills up, quantiles are exact.
+*/
+class quantile_sketch {
+public:
+  explicit quantile_sketch(const int _k = QUANTILE_SKETCH_K)
+    : k(_k), n(0), levels(1), size(0), max_size(std::max(_k, 2)),
+      coin(0x9e3779b97f4a7c15ULL) {}
+
+  /* add():
+     Adds the value v to the sketch.
+  */
+  void add(const int64_t v){
+    levels[0].push_back(v);
+    ++n;
+    if(++size >= max_size) compress();
+  }
+
+  /* merge():
+     Adds the values of another sketch to this one.
+  */
+  void merge(const quantile_sketch &other);
+
+  /* quantile():
+     @params
+     const double q               The quantile to estimate, in [0, 1]
+
+     @return
+     int64_t                      The value of rank ceil(q*n) (at least 1)
+                                  among the n values added, or 0 if none
+  */
+  int64_t quantile(const double q) const;
+
+  /* count():
+     @return
+     long long                    The number of values added
+  */
+  long long count() const { return n; }
+
+private:
+  std::size_t capacity(const std::size_t h) const;
+  void compress();
+  void compact(const std::size_t h);
+
+  int k;
+  long long n;
+  std::vector<std::vector<int64_t>> levels;
+  std::size_t size, max_size;           // Values kept, and room for them
+  uint64_t coin;                        // State of the random starts
+};
+
+#endif
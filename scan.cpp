@@ -0,0 +1,87 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+static const char *isa = "scalar";
+
+// Bytewise fallback
+static scan_masks scan_block_scalar(const char *p){
+  scan_masks m = {0, 0};
+  for(int i = 0; i < SCAN_BLOCK; ++i){
+    m.newline |= (uint64_t)(p[i] == '\n') << i;
+    m.comma   |= (uint64_t)(p[i] == ',')  << i;
+  }
+  return m;
+}
+
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+static scan_masks scan_block_sse2(const char *p){
+  const __m128i nl = _mm_set1_epi8('\n'), comma = _mm_set1_epi8(',');
+  scan_masks m = {0, 0};
+  for(int i = 0; i < SCAN_BLOCK; i += 16){
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    m.newline |= (uint64_t)(uint16_t)
+      _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) << i;
+    m.comma   |= (uint64_t)(uint16_t)
+      _mm_movemask_epi8(_mm_cmpeq_epi8(v, comma)) << i;
+  }
+  return m;
+}
+
+__attribute__((target("avx2")))
+static scan_masks scan_block_avx2(const char *p){
+  const __m256i nl = _mm256_set1_epi8('\n'), comma = _mm256_set1_epi8(',');
+  scan_masks m = {0, 0};
+  for(int i = 0; i < SCAN_BLOCK; i += 32){
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+    m.newline |= (uint64_t)(uint32_t)
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)) << i;
+    m.comma   |= (uint64_t)(uint32_t)
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, comma)) << i;
+  }
+  return m;
+}
+#endif
+
+// Picks the best implementation for this CPU
+static scan_masks (*pick_scan_block())(const char *){
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")){
+    isa = "avx2";
+    return scan_block_avx2;
+  }
+  if(__builtin_cpu_supports("sse2")){
+    isa = "sse2";
+    return scan_block_sse2;
+  }
+#endif
+  return scan_block_scalar;
+}
+
+scan_masks (*scan_block)(const char *p) = pick_scan_block();
+
+const char *scan_isa(){
+  return isa;
+}
+
+std::size_t count_newlines(const char *p, const char *end){
+  std::size_t n = 0;
+  for(; end - p >= SCAN_BLOCK; p += SCAN_BLOCK){
+    n += __builtin_popcountll(scan_block(p).newline);
+  }
+  for(; p != end; ++p){
+    n += (*p == '\n');
+  }
+  return n;
+}
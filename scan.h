@@ -0,0 +1,54 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstdint>
+#include <cstddef>
+
+/* struct scan_masks:
+   The positions of the separators used by the data parsers within a
+   block of SCAN_BLOCK bytes: bit i is set if byte i of the block is the
+   corresponding character.
+   (Comments need no mask, since only the first byte of a line can mark one.)
+*/
+#define SCAN_BLOCK 64
+struct scan_masks {
+  uint64_t newline;  // '\n'
+  uint64_t comma;    // ','
+};
+
+/* scan_block():
+   Classifies the SCAN_BLOCK bytes starting at p, 16 (SSE2) or 32 (AVX2)
+   bytes at a time where the CPU supports it, and bytewise otherwise.
+   The implementation is chosen at runtime, when the program starts.
+
+   @params
+   const char *p          The block to classify (SCAN_BLOCK bytes readable)
+
+   @return
+   scan_masks             The positions of the characters of interest
+*/
+extern scan_masks (*scan_block)(const char *p);
+
+/* scan_isa():
+   @return
+   const char *           The name of the scan_block implementation in use
+*/
+const char *scan_isa();
+
+/* count_newlines():
+   @params
+   const char *p          The text to search
+   const char *end
+
+   @return
+   std::size_t            The number of '\n' in [p, end)
+*/
+std::size_t count_newlines(const char *p, const char *end);
+
+#endif
@@ -0,0 +1,591 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include "serve.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "asciigraph_except.h"
+#include "graph.h"
+#include "linereader.h"
+#include "quantile.h"
+#include "stats.h"
+
+#define DEBUG if(debug)
+
+// The most digits of the length of a frame
+#define FRAME_DIGITS_MAX 12
+// Size of the pieces in which connections are read
+#define SERVE_READ_SIZE (64 << 10)
+
+// Throws the error of the failed system call what
+static void fail(const char *what){
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// The address of the socket at path
+static sockaddr_un socket_address(const std::string &path){
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(path.empty() || path.size() >= sizeof(addr.sun_path)){
+    throw std::system_error(ENAMETOOLONG, std::generic_category(), path);
+  }
+  std::memcpy(addr.sun_path, path.data(), path.size());
+  return addr;
+}
+
+/* Finds the frame at the start of buf: its header (the length and '\n')
+   is header bytes long and its body length bytes. Returns 1 if the whole
+   frame is in buf, 0 if more is needed, and -1 if it is malformed. */
+static int find_frame(const std::string &buf, std::size_t &header,
+		      std::size_t &length){
+  length = 0;
+  for(header = 0; header < buf.size(); ++header){
+    const char c = buf[header];
+    if(c == '\n' && header > 0){
+      ++header;
+      if(length > SERVE_REQUEST_MAX) return -1;
+      return (buf.size() - header >= length)  ?  1 : 0;
+    }
+    if(c < '0' || c > '9' || header == FRAME_DIGITS_MAX) return -1;
+    length = 10*length + (c - '0');
+  }
+  return 0;
+}
+
+// Appends the frame header of a body of the given length to buf
+static void append_header(std::string &buf, const std::size_t length){
+  char header[FRAME_DIGITS_MAX + 2];
+  const int n = std::snprintf(header, sizeof(header), "%zu\n", length);
+  buf.append(header, n);
+}
+
+
+/* struct serve_job:
+   A request and its reply. Jobs are reused, keeping their memory.
+*/
+struct serve_job {
+  uint64_t conn;                // The id of the connection to reply to
+  std::string request, reply;   // The bodies of their frames
+  double start;                 // When the request was read
+  bool failed;                  // Could the input not be graphed?
+};
+
+/* Class job_queue:
+   The jobs waiting for a worker, at most max of them.
+*/
+class job_queue {
+public:
+  explicit job_queue(const std::size_t _max) : max(_max), closed(false) {}
+
+  bool full(){
+    std::lock_guard<std::mutex> guard(lock);
+    return jobs.size() >= max;
+  }
+  void push(serve_job *job){
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      jobs.push_back(job);
+    }
+    ready.notify_one();
+  }
+  // The next job, or null once the queue is closed
+  serve_job *pop(){
+    std::unique_lock<std::mutex> guard(lock);
+    ready.wait(guard, [this]{ return closed || !jobs.empty(); });
+    if(closed) return nullptr;
+    serve_job *job = jobs.front();
+    jobs.pop_front();
+    return job;
+  }
+  void close(){
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      closed = true;
+    }
+    ready.notify_all();
+  }
+
+private:
+  std::size_t max;
+  bool closed;
+  std::deque<serve_job *> jobs;
+  std::mutex lock;
+  std::condition_variable ready;
+};
+
+
+/* struct serve_stats:
+   The requests served since the last report.
+*/
+struct serve_stats {
+  serve_stats() : requests(0), errors(0), start(stats_clock()) {}
+
+  void report(std::ostream &out, const std::size_t connections) const {
+    const double seconds = stats_clock() - start;
+    char buf[256];
+    std::snprintf(buf, sizeof(buf),
+		  "{\"requests\":%lld,\"requests_per_s\":%.1f,\"errors\":%lld,"
+		  "\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"connections\":%zu}\n",
+		  requests, (seconds > 0)  ?  requests/seconds : 0.0, errors,
+		  latency_us.quantile(0.5)/1000.0,
+		  latency_us.quantile(0.99)/1000.0, connections);
+    out << buf;
+    out.flush();
+  }
+
+  long long requests, errors;
+  double start;
+  quantile_sketch latency_us;   // From reading requests to their replies
+};
+
+
+/* Class graph_server:
+   The event loop of serveGraphs(), which reads requests, hands them to the
+   workers and writes their replies. Workers hand finished jobs back
+   through a list, waking the loop with an eventfd.
+*/
+class graph_server {
+public:
+  graph_server(const std::string &_path, const unsigned nworkers,
+	       const bool _debug);
+  ~graph_server();
+  void run();
+
+private:
+  struct connection {
+    connection(const int _fd)
+      : fd(_fd), sent(0), events(0), busy(false), waiting(false),
+	closing(false) {}
+    int fd;
+    std::string in, out;        // Read but not handed on / to write
+    std::size_t sent;           // Bytes of out written
+    uint32_t events;            // The epoll events watched
+    bool busy;                  // Is a request of it being graphed?
+    bool waiting;               // Is a request waiting for room to queue?
+    bool closing;               // Close once its requests are answered?
+  };
+
+  // epoll ids of the other file descriptors; connections follow
+  enum { LISTEN_ID, DONE_ID, SIGNAL_ID, FIRST_CONN_ID };
+
+  void shutdown();
+  void work();
+  void accept_all();
+  void read_from(const uint64_t id, connection &c);
+  void dispatch(const uint64_t id, connection &c);
+  void finish_jobs();
+  void write_to(const uint64_t id, connection &c);
+  void update(const uint64_t id, connection &c);
+  void close_conn(const uint64_t id);
+  void watch(const int fd, const uint64_t id, const uint32_t events);
+
+  std::string path;
+  bool debug;
+  int listen_fd, epoll_fd, done_fd, signal_fd;
+  sigset_t old_mask;
+  std::unordered_map<uint64_t, connection> conns;
+  uint64_t next_id;
+  std::deque<uint64_t> waiting;         // Connections waiting for room
+  std::vector<std::unique_ptr<serve_job>> jobs;
+  std::vector<serve_job *> free_jobs;
+  job_queue queue;
+  std::mutex done_lock;
+  std::vector<serve_job *> done, finished;  // Handed back by the workers
+  std::vector<std::thread> workers;
+  serve_stats stats;
+};
+
+graph_server::graph_server(const std::string &_path, const unsigned nworkers,
+			   const bool _debug)
+  : path(_path), debug(_debug), listen_fd(-1), epoll_fd(-1), done_fd(-1),
+    signal_fd(-1), next_id(FIRST_CONN_ID),
+    queue(SERVE_QUEUE_PER_WORKER*(std::size_t)nworkers){
+  const sockaddr_un addr = socket_address(path);
+  try{
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listen_fd < 0) fail("socket");
+    if(bind(listen_fd, (const sockaddr *)&addr, sizeof(addr)) < 0){
+      if(errno != EADDRINUSE) fail("bind");
+      // Replace the socket of a server no longer running
+      const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      const bool live = probe >= 0 &&
+	connect(probe, (const sockaddr *)&addr, sizeof(addr)) == 0;
+      if(probe >= 0) close(probe);
+      errno = EADDRINUSE;
+      if(live) fail("bind");
+      unlink(path.c_str());
+      if(bind(listen_fd, (const sockaddr *)&addr, sizeof(addr)) < 0){
+	fail("bind");
+      }
+    }
+    if(listen(listen_fd, SOMAXCONN) < 0) fail("listen");
+
+    // Interrupts are read from signal_fd (workers inherit the mask)
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(signal_fd < 0) fail("signalfd");
+    done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(done_fd < 0) fail("eventfd");
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd < 0) fail("epoll_create1");
+    watch(listen_fd, LISTEN_ID, EPOLLIN);
+    watch(done_fd, DONE_ID, EPOLLIN);
+    watch(signal_fd, SIGNAL_ID, EPOLLIN);
+  }catch(...){
+    shutdown();
+    throw;
+  }
+
+  // Every job is either queued, being graphed, or free
+  const std::size_t njobs = SERVE_QUEUE_PER_WORKER*(std::size_t)nworkers +
+                            nworkers;
+  for(std::size_t k = 0; k < njobs; ++k){
+    jobs.emplace_back(new serve_job);
+    free_jobs.push_back(jobs.back().get());
+  }
+  for(unsigned k = 0; k < nworkers; ++k){
+    workers.emplace_back(&graph_server::work, this);
+  }
+}
+
+graph_server::~graph_server(){
+  shutdown();
+}
+
+// Stops the workers and closes every file descriptor
+void graph_server::shutdown(){
+  queue.close();
+  for(auto it = workers.begin(); it != workers.end(); ++it) it -> join();
+  workers.clear();
+  for(auto it = conns.begin(); it != conns.end(); ++it) close(it -> second.fd);
+  conns.clear();
+  if(listen_fd >= 0){
+    close(listen_fd);
+    unlink(path.c_str());
+  }
+  if(epoll_fd >= 0) close(epoll_fd);
+  if(done_fd >= 0) close(done_fd);
+  if(signal_fd >= 0){
+    close(signal_fd);
+    pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+  }
+  listen_fd = epoll_fd = done_fd = signal_fd = -1;
+}
+
+void graph_server::watch(const int fd, const uint64_t id,
+			 const uint32_t events){
+  epoll_event ev;
+  ev.events = events;
+  ev.data.u64 = id;
+  if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) fail("epoll_ctl");
+}
+
+// Worker thread body: graphs requests with buffers of its own
+void graph_server::work(){
+  graph_buffers buf;
+  string_buf reply;
+  std::ostream out(&reply);
+  buf.out = &out;
+  while(serve_job *job = queue.pop()){
+    job -> reply.clear();
+    job -> failed = false;
+    reply.attach(&job -> reply);
+    try{
+      const char *data = job -> request.data();
+      line_reader in(data, data + job -> request.size());
+      streamGraph(in, buf, debug, nullptr);
+    }catch(const invalid_data &e){
+      job -> failed = true;
+      out << "The data provided is invalid, with error \"" << e.what()
+	  << "\". Please read the readme for data format requirements."
+	  << std::endl;
+    }catch(const std::exception &e){
+      job -> failed = true;
+      out << "The data could not be graphed, with error \"" << e.what()
+	  << "\"." << std::endl;
+    }
+    out.flush();
+    out.clear();
+    {
+      std::lock_guard<std::mutex> guard(done_lock);
+      done.push_back(job);
+    }
+    const uint64_t one = 1;
+    if(write(done_fd, &one, sizeof(one)) < 0){} // Already signalled if full
+  }
+}
+
+void graph_server::run(){
+  const int max_events = 64;
+  epoll_event events[max_events];
+  double next_report = stats_clock() + SERVE_REPORT_INTERVAL;
+  for(;;){
+    const int timeout = std::max(0, (int)((next_report - stats_clock())*1000));
+    const int n = epoll_wait(epoll_fd, events, max_events, timeout);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      fail("epoll_wait");
+    }
+    for(int k = 0; k < n; ++k){
+      const uint64_t id = events[k].data.u64;
+      if(id == LISTEN_ID) accept_all();
+      else if(id == DONE_ID) finish_jobs();
+      else if(id == SIGNAL_ID){
+	DEBUG std::cerr << "interrupted, stopping" << std::endl;
+	if(stats.requests > 0) stats.report(std::cerr, conns.size());
+	return;
+      }
+      else{
+	auto it = conns.find(id);
+	if(it == conns.end()) continue;
+	connection &c = it -> second;
+	if(events[k].events & (EPOLLERR | EPOLLHUP)){
+	  close_conn(id);
+	  continue;
+	}
+	if(events[k].events & EPOLLOUT) write_to(id, c);
+	if(conns.count(id) && (events[k].events & EPOLLIN)) read_from(id, c);
+      }
+    }
+    if(stats_clock() >= next_report){
+      if(stats.requests > 0) stats.report(std::cerr, conns.size());
+      stats = serve_stats();
+      next_report = stats_clock() + SERVE_REPORT_INTERVAL;
+    }
+  }
+}
+
+void graph_server::accept_all(){
+  for(;;){
+    const int fd = accept4(listen_fd, nullptr, nullptr,
+			   SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd < 0){
+      if(errno == EINTR || errno == ECONNABORTED) continue;
+      // EAGAIN: none left; otherwise (e.g. out of fds) try again later
+      return;
+    }
+    const uint64_t id = next_id++;
+    connection &c = conns.emplace(id, connection(fd)).first -> second;
+    c.events = EPOLLIN;
+    watch(fd, id, c.events);
+    DEBUG std::cerr << "connection " << id << " accepted" << std::endl;
+  }
+}
+
+// Reads requests until one is whole (later ones wait for its reply)
+void graph_server::read_from(const uint64_t id, connection &c){
+  std::size_t header, length;
+  while(find_frame(c.in, header, length) == 0){
+    const std::size_t size = c.in.size();
+    c.in.resize(size + SERVE_READ_SIZE);
+    const ssize_t got = read(c.fd, &c.in[size], SERVE_READ_SIZE);
+    c.in.resize(size + std::max<ssize_t>(got, 0));
+    if(got > 0) continue;
+    if(got < 0 && errno == EINTR) continue;
+    if(got < 0 && errno == EAGAIN) break;
+    // The client is done sending: answer what it sent, then close
+    c.closing = true;
+    break;
+  }
+  dispatch(id, c);
+  write_to(id, c);
+}
+
+// Hands the connection's next request (if whole) to the workers
+void graph_server::dispatch(const uint64_t id, connection &c){
+  std::size_t header, length;
+  const int found = c.busy  ?  0 : find_frame(c.in, header, length);
+  if(found < 0){
+    DEBUG std::cerr << "connection " << id << ": malformed request"
+		    << std::endl;
+    const char message[] = "The request was not framed by its length.\n";
+    append_header(c.out, sizeof(message) - 1);
+    c.out += message;
+    c.in.clear();
+    c.closing = true;
+    ++stats.errors;
+  }
+  else if(found > 0 && !c.waiting){
+    if(queue.full() || free_jobs.empty()){
+      c.waiting = true;
+      waiting.push_back(id);
+    }
+    else{
+      serve_job *job = free_jobs.back();
+      free_jobs.pop_back();
+      job -> conn = id;
+      job -> request.assign(c.in, header, length);
+      job -> start = stats_clock();
+      c.in.erase(0, header + length);
+      c.busy = true;
+      queue.push(job);
+    }
+  }
+}
+
+// Queues the replies of the jobs the workers have finished
+void graph_server::finish_jobs(){
+  uint64_t count;
+  if(read(done_fd, &count, sizeof(count)) < 0){}
+  {
+    std::lock_guard<std::mutex> guard(done_lock);
+    finished.swap(done);
+  }
+  for(auto it = finished.begin(); it != finished.end(); ++it){
+    serve_job *job = *it;
+    ++stats.requests;
+    if(job -> failed) ++stats.errors;
+    stats.latency_us.add((int)std::min(1e9, (stats_clock() - job -> start)*1e6));
+    auto conn = conns.find(job -> conn);
+    if(conn != conns.end()){
+      connection &c = conn -> second;
+      append_header(c.out, job -> reply.size());
+      c.out += job -> reply;
+      c.busy = false;
+      dispatch(job -> conn, c);
+      write_to(job -> conn, c);
+    }
+    free_jobs.push_back(job);
+  }
+  finished.clear();
+  // Queue the requests which were waiting for room
+  while(!waiting.empty() && !queue.full() && !free_jobs.empty()){
+    const uint64_t id = waiting.front();
+    waiting.pop_front();
+    auto conn = conns.find(id);
+    if(conn == conns.end()) continue;
+    conn -> second.waiting = false;
+    dispatch(id, conn -> second);
+    update(id, conn -> second);
+  }
+}
+
+// Writes as much of the connection's replies as it takes
+void graph_server::write_to(const uint64_t id, connection &c){
+  while(c.sent < c.out.size()){
+    const ssize_t put = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent,
+			     MSG_NOSIGNAL);
+    if(put < 0){
+      if(errno == EINTR) continue;
+      if(errno == EAGAIN) break;
+      close_conn(id);
+      return;
+    }
+    c.sent += put;
+  }
+  if(c.sent == c.out.size()){
+    c.out.clear();
+    c.sent = 0;
+  }
+  std::size_t header, length;
+  if(c.closing && !c.busy && !c.waiting && c.out.empty() &&
+     find_frame(c.in, header, length) != 1){
+    close_conn(id);
+    return;
+  }
+  update(id, c);
+}
+
+// Watches the connection for what it is waiting on
+void graph_server::update(const uint64_t id, connection &c){
+  std::size_t header, length;
+  uint32_t events = 0;
+  if(!c.closing && find_frame(c.in, header, length) == 0) events |= EPOLLIN;
+  if(!c.out.empty()) events |= EPOLLOUT;
+  if(events == c.events) return;
+  epoll_event ev;
+  ev.events = events;
+  ev.data.u64 = id;
+  if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.fd, &ev) < 0) fail("epoll_ctl");
+  c.events = events;
+}
+
+void graph_server::close_conn(const uint64_t id){
+  auto it = conns.find(id);
+  if(it == conns.end()) return;
+  // Closing the fd also removes it from the epoll set
+  close(it -> second.fd);
+  conns.erase(it);
+  DEBUG std::cerr << "connection " << id << " closed" << std::endl;
+}
+
+
+void serveGraphs(const std::string &path, unsigned workers, const bool debug){
+  if(workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+  graph_server server(path, workers, debug);
+  DEBUG std::cerr << "serving on " << path << " with " << workers
+		  << " workers" << std::endl;
+  server.run();
+}
+
+void sendGraph(const std::string &path, std::istream &in, std::ostream &out){
+  const sockaddr_un addr = socket_address(path);
+  const std::string request((std::istreambuf_iterator<char>(in)),
+			    std::istreambuf_iterator<char>());
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd < 0) fail("socket");
+  std::string buf;
+  try{
+    if(connect(fd, (const sockaddr *)&addr, sizeof(addr)) < 0) fail("connect");
+    append_header(buf, request.size());
+    buf += request;
+    for(std::size_t sent = 0; sent < buf.size(); ){
+      const ssize_t put = send(fd, buf.data() + sent, buf.size() - sent,
+			       MSG_NOSIGNAL);
+      if(put < 0){
+	if(errno == EINTR) continue;
+	fail("send");
+      }
+      sent += put;
+    }
+    // Read the reply
+    buf.clear();
+    std::size_t header, length;
+    int found;
+    while((found = find_frame(buf, header, length)) == 0){
+      const std::size_t size = buf.size();
+      buf.resize(size + SERVE_READ_SIZE);
+      const ssize_t got = read(fd, &buf[size], SERVE_READ_SIZE);
+      buf.resize(size + std::max<ssize_t>(got, 0));
+      if(got < 0 && errno == EINTR) continue;
+      if(got < 0) fail("read");
+      if(got == 0) throw invalid_data("reply cut short");
+    }
+    if(found < 0) throw invalid_data("malformed reply");
+    out.write(buf.data() + header, length);
+    out.flush();
+  }catch(...){
+    close(fd);
+    throw;
+  }
+  close(fd);
+}
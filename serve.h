@@ -0,0 +1,70 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <iostream>
+#include <string>
+
+// Requests queued per worker; beyond this connections are not read
+#define SERVE_QUEUE_PER_WORKER 4
+// The largest request (or reply) accepted, in bytes
+#define SERVE_REQUEST_MAX (256 << 20)
+// Seconds between reports of the requests served
+#define SERVE_REPORT_INTERVAL 10
+
+
+/* serveGraphs():
+   Serves graphs on a Unix domain socket until interrupted (SIGINT or
+   SIGTERM). A request is framed as its length in bytes, in decimal, on a
+   line of its own, followed by that many bytes of input in the usual
+   format (options and data, possibly a batch of graphs). Its reply is
+   framed likewise and holds the graphs `asciigraph -s` prints for the
+   input (or why it could not be graphed).
+   A connection may send any number of requests; they are answered in
+   order.
+   Connections are served by an event loop and requests graphed by a fixed
+   pool of workers, each reusing its own buffers from one request to the
+   next. While the workers' queue is full, no more requests are read.
+   Every SERVE_REPORT_INTERVAL seconds in which requests were served (and
+   on exit), the requests per second and latency percentiles are reported
+   as a line of JSON on stderr.
+
+   @params
+   const std::string &path     The path of the socket (a stale socket left
+                               there is replaced)
+   unsigned workers            The number of workers, or 0 for one per
+                               hardware thread
+   const bool debug            Print debug info?
+
+   @return
+   void
+
+   @throws
+   std::system_error           The socket could not be set up
+*/
+void serveGraphs(const std::string &path, unsigned workers, const bool debug);
+
+/* sendGraph():
+   A client of serveGraphs(): sends all of the input read from in as one
+   request to the server on the socket at path, and writes its reply out.
+
+   @params
+   const std::string &path     The path of the server's socket
+   std::istream &in            The input to graph
+   std::ostream &out           Where to write the graphs
+
+   @return
+   void
+
+   @throws
+   std::system_error           The server could not be reached
+   invalid_data                The reply was cut short or malformed
+*/
+void sendGraph(const std::string &path, std::istream &in, std::ostream &out);
+
+#endif
@@ -0,0 +1,37 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include "stats.h"
+#include <cstdio>
+
+run_stats &run_stats::operator+=(const run_stats &other){
+  header_s   += other.header_s;
+  parse_s    += other.parse_s;
+  prepare_s  += other.prepare_s;
+  render_s   += other.render_s;
+  output_s   += other.output_s;
+  lines      += other.lines;
+  comments   += other.comments;
+  points     += other.points;
+  rounded    += other.rounded;
+  outside    += other.outside;
+  duplicates += other.duplicates;
+  bytes      += other.bytes;
+  return *this;
+}
+
+void run_stats::report(std::ostream &out) const {
+  char buf[512];
+  std::snprintf(buf, sizeof(buf),
+		"{\"header_s\":%.6f,\"parse_s\":%.6f,\"prepare_s\":%.6f,"
+		"\"render_s\":%.6f,\"output_s\":%.6f,\"lines\":%lld,"
+		"\"comments\":%lld,\"points\":%lld,\"rounded\":%lld,"
+		"\"outside\":%lld,\"duplicates\":%lld,\"bytes\":%zu}\n",
+		header_s, parse_s, prepare_s, render_s, output_s, lines,
+		comments, points, rounded, outside, duplicates, bytes);
+  out << buf;
+  out.flush();
+}
@@ -0,0 +1,82 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+
+
+/* struct run_stats:
+   Timings and counters of a run, collected when requested (--stats).
+   Stages which are given a null run_stats * collect nothing.
+*/
+struct run_stats {
+  // Seconds spent in each stage
+  double header_s  = 0;    // Reading the option header
+  double parse_s   = 0;    // Reading the data
+  double prepare_s = 0;    // asciigraph::prepare_data()
+  double render_s  = 0;    // Drawing rows (excluding writing them)
+  double output_s  = 0;    // Writing the graph out
+  // Counters
+  long long lines      = 0;  // Lines read, including options and comments
+  long long comments   = 0;  // Comment lines skipped
+  long long points     = 0;  // Data points read
+  long long rounded    = 0;  // Points whose y-value was rounded by ystep
+  long long outside    = 0;  // Points outside of the graph's limits
+  long long duplicates = 0;  // Points dropped on a cell already drawn
+  std::size_t bytes    = 0;  // Bytes of graph output
+
+  /* operator+=:
+     Adds the timings and counters of other (e.g. those of another thread)
+     to these.
+  */
+  run_stats &operator+=(const run_stats &other);
+
+  /* report():
+     Prints the stats as one JSON object on a line of its own.
+  */
+  void report(std::ostream &out) const;
+};
+
+// The current time in seconds, for timing stages
+inline double stats_clock(){
+  return std::chrono::duration<double>
+    (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/* Class counting_buf:
+   A stream buffer which passes everything written to it on to another,
+   counting the bytes.
+*/
+class counting_buf : public std::streambuf {
+public:
+  explicit counting_buf(std::streambuf *_dest) : dest(_dest), bytes(0) {}
+  std::size_t count() const { return bytes; }
+
+protected:
+  int overflow(int c) override {
+    if(c == traits_type::eof()) return traits_type::not_eof(c);
+    ++bytes;
+    return dest -> sputc(c);
+  }
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    std::streamsize put = dest -> sputn(s, n);
+    bytes += put;
+    return put;
+  }
+  int sync() override { return dest -> pubsync(); }
+
+private:
+  std::streambuf *dest;
+  std::size_t bytes;
+};
+
+#endif
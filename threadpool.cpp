@@ -0,0 +1,86 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include "threadpool.h"
+
+thread_pool::thread_pool(unsigned threads /* = 0 */)
+  : running(false), stopping(false), batch(0), busy(0), task(nullptr),
+    ntasks(0), next(0){
+  if(threads == 0){
+    unsigned hw = std::thread::hardware_concurrency();
+    threads = (hw > 1)  ?  hw - 1 : 0;
+  }
+  for(unsigned i = 0; i < threads; ++i){
+    workers.emplace_back(&thread_pool::work, this);
+  }
+}
+
+thread_pool::~thread_pool(){
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for(auto it = workers.begin(); it != workers.end(); ++it){
+    it -> join();
+  }
+}
+
+void thread_pool::run(std::size_t n,
+		      const std::function<void(std::size_t)> &_task){
+  // A pool runs one batch at a time: batches run from other threads (or
+  // from tasks) meanwhile are run by their caller alone
+  bool idle = false;
+  if(workers.empty() || n <= 1 ||
+     !running.compare_exchange_strong(idle, true)){
+    for(std::size_t i = 0; i < n; ++i) _task(i);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    task = &_task;
+    ntasks = n;
+    next = 0;
+    busy = workers.size();
+    ++batch;
+  }
+  wake.notify_all();
+  take_tasks();
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [this]{ return busy == 0; });
+  task = nullptr;
+  running = false;
+}
+
+// Runs tasks from the current batch until there are none left
+void thread_pool::take_tasks(){
+  for(std::size_t i = next++; i < ntasks; i = next++){
+    (*task)(i);
+  }
+}
+
+// Worker thread body
+void thread_pool::work(){
+  unsigned long seen = 0;
+  for(;;){
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [&]{ return stopping || batch != seen; });
+      if(stopping) return;
+      seen = batch;
+    }
+    take_tasks();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if(--busy == 0) done.notify_one();
+    }
+  }
+}
+
+thread_pool &shared_pool(){
+  static thread_pool pool;
+  return pool;
+}
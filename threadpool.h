@@ -0,0 +1,74 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Class thread_pool:
+   A fixed set of worker threads which run batches of independent tasks.
+   The calling thread takes part in each batch as well, so a pool of n
+   threads runs tasks on n + 1 threads at once.
+*/
+class thread_pool {
+public:
+  /* thread_pool::Constructor:
+     @params
+     unsigned threads = 0        Worker threads to start; 0 picks one less
+                                 than the number of hardware threads
+  */
+  explicit thread_pool(unsigned threads = 0);
+  ~thread_pool();
+  thread_pool(const thread_pool &) = delete;
+  thread_pool &operator=(const thread_pool &) = delete;
+
+  /* run():
+     Calls task(i) for every i in [0, n), spread across the pool, and
+     returns once all calls have finished. Tasks must not throw.
+     run() may be called from several threads at once: while one batch
+     runs on the pool, the others run on their calling threads.
+
+     @params
+     std::size_t n                                  The number of tasks
+     const std::function<void(std::size_t)> &task   The task to run
+  */
+  void run(std::size_t n, const std::function<void(std::size_t)> &task);
+
+  // The number of threads (including the caller) which run tasks
+  unsigned size() const { return workers.size() + 1; }
+
+private:
+  void work();
+  void take_tasks();
+
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable wake, done;
+  std::atomic<bool> running;  // Is a batch running on the pool?
+  bool stopping;
+  unsigned long batch;     // Incremented for each call to run()
+  unsigned busy;           // Workers still running the current batch
+  // The current batch
+  const std::function<void(std::size_t)> *task;
+  std::size_t ntasks;
+  std::atomic<std::size_t> next;
+};
+
+/* shared_pool():
+   @return
+   thread_pool &               The pool shared by everything run in
+                               parallel, started on first use
+*/
+thread_pool &shared_pool();
+
+#endif
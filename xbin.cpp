@@ -0,0 +1,156 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#include "xbin.h"
+#include <algorithm>
+#include <cmath>
+
+bool parse_aggregator(const std::string &name, aggregator *agg){
+  if(name == "min")        *agg = AGG_MIN;
+  else if(name == "max")   *agg = AGG_MAX;
+  else if(name == "mean")  *agg = AGG_MEAN;
+  else if(name == "last")  *agg = AGG_LAST;
+  else if(name == "count") *agg = AGG_COUNT;
+  else if(name == "span")  *agg = AGG_SPAN;
+  else return false;
+  return true;
+}
+
+void xbinner::merge(const xbinner &later){
+  for(auto it = later.bins.begin(); it != later.bins.end(); ++it){
+    xbin &b = bins[it -> first];
+    const xbin &l = it -> second;
+    if(b.count == 0 || l.min < b.min) b.min = l.min;
+    if(b.count == 0 || l.max > b.max) b.max = l.max;
+    b.last = l.last;
+    b.sum += l.sum;
+    b.count += l.count;
+  }
+}
+
+void xbinner::aggregate(std::vector<std::pair<int64_t, int64_t>> &pts) const {
+  pts.clear();
+  pts.reserve(agg == AGG_SPAN ? 2*bins.size() : bins.size());
+  for(auto it = bins.begin(); it != bins.end(); ++it){
+    const xbin &b = it -> second;
+    switch(agg){
+    case AGG_MIN:   pts.push_back(std::make_pair(it -> first, b.min));  break;
+    case AGG_MAX:   pts.push_back(std::make_pair(it -> first, b.max));  break;
+    case AGG_LAST:  pts.push_back(std::make_pair(it -> first, b.last)); break;
+    case AGG_MEAN:
+      pts.push_back(std::make_pair(it -> first, (int64_t)(b.sum/b.count)));
+      break;
+    case AGG_COUNT:
+      pts.push_back(std::make_pair(it -> first, (int64_t)b.count));
+      break;
+    case AGG_SPAN:
+      pts.push_back(std::make_pair(it -> first, b.min));
+      pts.push_back(std::make_pair(it -> first, b.max));
+      break;
+    }
+  }
+}
+
+void xbinner::fill_spans(std::vector<std::pair<int64_t, int64_t>> &pts,
+			 const int64_t ystep) const {
+  if(agg != AGG_SPAN) return;
+  const std::size_t n = pts.size();
+  for(std::size_t i = 0; i + 1 < n; i += 2){
+    const int64_t x = pts[i].first, lo = pts[i].second,
+      hi = pts[i + 1].second;
+    // First multiple of ystep above lo
+    int64_t y = lo - lo%ystep;
+    if(y <= lo) y += ystep;
+    for(; y < hi; y += ystep){
+      pts.push_back(std::make_pair(x, y));
+    }
+  }
+}
+
+// The bin of x, for bins of xstep x-values starting at multiples of xstep
+static long long bin_of(const int64_t x, const int64_t xstep){
+  return x/xstep - (x%xstep < 0);
+}
+
+bool group_bins(std::vector<std::pair<int64_t, int64_t>> &pts,
+		std::size_t first, const std::size_t last, const int64_t xstep){
+  if(last - first < 2) return true;
+  long long lo = bin_of(pts[first].first, xstep), hi = lo;
+  for(std::size_t i = first + 1; i < last; ++i){
+    const long long bin = bin_of(pts[i].first, xstep);
+    if(bin < lo) lo = bin;
+    if(bin > hi) hi = bin;
+  }
+  // More bins than points: counting them would cost more than sorting
+  if((unsigned long long)hi - (unsigned long long)lo >= last - first){
+    return false;
+  }
+
+  // Count the points of each bin, then copy them to the start of theirs
+  std::vector<std::size_t> start(hi - lo + 2, 0);
+  for(std::size_t i = first; i < last; ++i){
+    ++start[bin_of(pts[i].first, xstep) - lo + 1];
+  }
+  for(std::size_t b = 1; b < start.size(); ++b) start[b] += start[b - 1];
+  std::vector<std::pair<int64_t, int64_t>> grouped(last - first);
+  for(std::size_t i = first; i < last; ++i){
+    grouped[start[bin_of(pts[i].first, xstep) - lo]++] = pts[i];
+  }
+  std::copy(grouped.begin(), grouped.end(), pts.begin() + first);
+  return true;
+}
+
+std::size_t downsample_lttb(std::vector<std::pair<int64_t, int64_t>> &pts,
+			    std::size_t first, const std::size_t last,
+			    const int64_t xstep){
+  std::size_t out = first;
+  std::pair<int64_t, int64_t> kept;                 // The point kept in the last bin
+  for(std::size_t b = first, e; b < last; b = e){
+    // This bin is [b, e) and the next [e, ne)
+    const long long bin = bin_of(pts[b].first, xstep);
+    for(e = b + 1; e < last && bin_of(pts[e].first, xstep) == bin; ++e);
+    // The bins need only be in order: the point of least x (the first of
+    // them) is kept in the first, and of most x (the last) in the last
+    std::size_t sel = b;
+    if(e == last){
+      sel = last - 1;
+      for(std::size_t i = b; i < e; ++i){
+	if(pts[i].first >= pts[sel].first) sel = i;
+      }
+    }
+    else if(out == first){
+      for(std::size_t i = b + 1; i < e; ++i){
+	if(pts[i].first < pts[sel].first) sel = i;
+      }
+    }
+    else{
+      const long long next = bin_of(pts[e].first, xstep);
+      double cx = 0, cy = 0;
+      std::size_t ne = e;
+      for(; ne < last && bin_of(pts[ne].first, xstep) == next; ++ne){
+	cx += pts[ne].first;
+	cy += pts[ne].second;
+      }
+      cx /= ne - e;
+      cy /= ne - e;
+      // Twice the area of the triangle of kept, pts[i] and (cx, cy)
+      double best = -1;
+      for(std::size_t i = b; i < e; ++i){
+	const double area =
+	  std::abs((kept.first - cx)*((double)pts[i].second - kept.second) -
+		   ((double)kept.first - pts[i].first)*(cy - kept.second));
+	if(area > best || (area == best && pts[i].first < pts[sel].first)){
+	  best = area;
+	  sel = i;
+	}
+      }
+    }
+    // Points are only moved down, over bins already done
+    kept = pts[sel];
+    pts[out++] = kept;
+  }
+  return out;
+}
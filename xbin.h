@@ -0,0 +1,172 @@
+/**************************************************/
+/* Author: Lukas Lazarek                          */
+/* Copyright (C) 2016 Lukas Lazarek               */
+/* Please see LICENSE.txt for full license info   */
+/**************************************************/
+
+#ifndef XBIN_H
+#define XBIN_H
+
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+/* enum aggregator:
+   The ways in which the y-values falling into a single x bin can be
+   combined into the value(s) plotted for that bin.
+*/
+enum aggregator {
+  AGG_MIN,    // Smallest y-value
+  AGG_MAX,    // Largest y-value
+  AGG_MEAN,   // Mean of the y-values (rounded toward zero)
+  AGG_LAST,   // Last y-value read
+  AGG_COUNT,  // Number of y-values
+  AGG_SPAN    // Vertical line from the smallest to the largest y-value
+};
+#define AGGREGATOR_DEFAULT AGG_MEAN
+
+/* parse_aggregator():
+   Looks up the aggregator with the given name (one of "min", "max", "mean",
+   "last", "count" or "span").
+
+   @params
+   const std::string &name    The name of the aggregator
+   aggregator *agg            Set to the aggregator if found
+
+   @return
+   bool                       Was the name recognized?
+*/
+bool parse_aggregator(const std::string &name, aggregator *agg);
+
+
+/* struct xbin:
+   The running aggregate of all y-values seen so far in one x bin.
+*/
+struct xbin {
+  int64_t min, max, last;
+  long long sum, count;
+
+  void add(const int64_t y){
+    if(count == 0 || y < min) min = y;
+    if(count == 0 || y > max) max = y;
+    last = y;
+    sum += y;
+    ++count;
+  }
+};
+
+
+/* Class xbinner:
+   Groups points into bins of xstep x-values in a single streaming pass,
+   keeping only one running aggregate per bin. Bins start at multiples of
+   xstep, so that bin boundaries line up with the columns drawn by
+   asciigraph for the same xstep.
+*/
+class xbinner {
+public:
+  xbinner(const int64_t _xstep, const aggregator _agg)
+    : xstep(_xstep), agg(_agg), last(nullptr), last_key(0) {}
+  xbinner(xbinner &&) = default;
+  xbinner(const xbinner &) = delete;
+  xbinner &operator=(const xbinner &) = delete;
+
+  /* add():
+     Adds the point (x, y) to its bin.
+  */
+  void add(const int64_t x, const int64_t y){
+    const int64_t key = bin_start(x);
+    if(last == nullptr || last_key != key){
+      // Consecutive points usually share a bin: only search on a change
+      last = &bins[key];
+      last_key = key;
+    }
+    last -> add(y);
+  }
+
+  /* merge():
+     Adds the bins of another binner with the same xstep and aggregator,
+     which read the data following this binner's data.
+  */
+  void merge(const xbinner &later);
+
+  /* aggregate():
+     Replaces the contents of pts with the aggregated (x, y) point(s) of
+     each bin, in ascending x order. For AGG_SPAN two points are produced
+     per bin, its minimum and maximum: see fill_spans().
+  */
+  void aggregate(std::vector<std::pair<int64_t, int64_t>> &pts) const;
+
+  /* fill_spans():
+     For AGG_SPAN, fills in the points between each bin's minimum and
+     maximum (as produced by aggregate()) at every multiple of ystep so
+     that each bin is drawn as a solid vertical line. Must be called once
+     the final ystep is known.
+  */
+  void fill_spans(std::vector<std::pair<int64_t, int64_t>> &pts,
+		  const int64_t ystep) const;
+
+  std::size_t size() const { return bins.size(); }
+  bool counting() const { return agg == AGG_COUNT; }
+  int64_t step() const { return xstep; }
+  aggregator kind() const { return agg; }
+  
+private:
+  int64_t bin_start(const int64_t x) const {
+    int64_t off_by = x%xstep;
+    if(off_by < 0) off_by += xstep;
+    return x - off_by;
+  }
+  
+  int64_t xstep;
+  aggregator agg;
+  std::map<int64_t, xbin> bins; // Keyed by bin start
+  xbin *last;                   // The bin last added to
+  int64_t last_key;
+};
+
+
+/* group_bins():
+   Orders the points pts[first] .. pts[last - 1] by their bin of xstep
+   x-values (as for xbinner), keeping the order of the points within each
+   bin, with a counting sort: in linear time, unlike sorting them by x.
+   Points spread over more bins than there are points are left as they
+   are, as counting the bins would cost more than sorting.
+
+   @params
+   std::vector<std::pair<int64_t, int64_t>> &pts   The points to order
+   std::size_t first                        The range of points
+   std::size_t last
+   const int64_t xstep                      The width of each bin
+
+   @return
+   bool                                     Were the points ordered?
+*/
+bool group_bins(std::vector<std::pair<int64_t, int64_t>> &pts,
+		std::size_t first, const std::size_t last, const int64_t xstep);
+
+/* downsample_lttb():
+   Reduces the points pts[first] .. pts[last - 1], in order of their bins
+   (sorted by x, or grouped by group_bins()), to one point per bin of
+   xstep x-values (bins starting at multiples of xstep, as for xbinner)
+   with Largest-Triangle-Three-Buckets: the first and the last point (by
+   x) are kept, and in each bin between them the point forming the
+   largest triangle with the point kept in the bin before and the mean of
+   the bin after, so that spikes survive where a mean would flatten them.
+   Runs in a single pass, moving the points kept to the front of the range.
+
+   @params
+   std::vector<std::pair<int64_t, int64_t>> &pts   The points to downsample
+   std::size_t first                        The range of points
+   std::size_t last
+   const int64_t xstep                      The width of each bin
+
+   @return
+   std::size_t                              The end of the points kept
+*/
+std::size_t downsample_lttb(std::vector<std::pair<int64_t, int64_t>> &pts,
+			    std::size_t first, const std::size_t last,
+			    const int64_t xstep);
+
+#endif